@@ -0,0 +1,235 @@
+/*
+   Counts over several moving windows of count bins
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "CountWindows.h"
+
+// Constructor, one minute window of 5 seconds bins
+CountWindows::CountWindows()
+{
+  uint16_t win_s[CW_WIN_MAX] = { 60 };
+  setup(5, win_s);
+}
+
+// Check a configuration
+// The bins divide a day so that they can be aligned on UTC time, the
+// windows are whole bins, CW_BINS_MAX at most. The list of windows ends at
+// the first 0 or after CW_WIN_MAX windows, there is at least one.
+byte CountWindows::valid(unsigned int bin_s, const uint16_t *win_s)
+{
+  byte w;
+
+  if (bin_s == 0 || 86400UL % bin_s != 0 || win_s[0] == 0)
+    return 0;
+
+  for (w = 0 ; w < CW_WIN_MAX && win_s[w] != 0 ; w++)
+    if (win_s[w] % bin_s != 0 || win_s[w] / bin_s > CW_BINS_MAX)
+      return 0;
+
+  return 1;
+}
+
+// Set the length of the bins and windows, in seconds, and reset
+// returns 0 and keeps the current windows when the configuration is not
+// valid()
+byte CountWindows::setup(unsigned int bin_s, const uint16_t *win_s)
+{
+  unsigned int a, b, t;
+  byte w;
+
+  if (!valid(bin_s, win_s))
+    return 0;
+
+  _bin_s = bin_s;
+  _size = 0;
+  for (w = 0 ; w < CW_WIN_MAX && win_s[w] != 0 ; w++)
+  {
+    _len[w] = win_s[w] / bin_s;
+    if (_len[w] > _size)
+      _size = _len[w];
+
+    // CPM = sum * 60 / win_s, reduced so that the product does not
+    // overflow: _mul is at most 60
+    a = 60;
+    b = win_s[w];
+    while (b != 0)
+    {
+      t = a % b;
+      a = b;
+      b = t;
+    }
+    _mul[w] = 60 / a;
+    _div[w] = win_s[w] / a;
+  }
+  _n_win = w;
+
+  // the adaptive window is at most as long as the first window
+  for (_n_dy = 0 ; _n_dy < CW_DY_MAX && (1u << _n_dy) < _len[0] ; _n_dy++)
+    ;
+
+  reset();
+  return 1;
+}
+
+// Empty the windows
+void CountWindows::reset()
+{
+  byte w;
+
+  _head = 0;
+  _n_bins = 0;
+  for (w = 0 ; w < _n_win ; w++)
+    _sum[w] = 0;
+  for (w = 0 ; w < _n_dy ; w++)
+    _dy_sum[w] = 0;
+  _ad_n = 0;
+  _ad_sum = 0;
+}
+
+// Add the count of the last bin to all windows
+void CountWindows::add(unsigned long count)
+{
+  unsigned int old, m;
+  byte w;
+
+  for (w = 0 ; w < _n_win ; w++)
+  {
+    _sum[w] += count;
+
+    // the bin that leaves the window, when it is full
+    if (_n_bins >= _len[w])
+    {
+      old = _head + _size - _len[w];
+      if (old >= _size)
+        old -= _size;
+      _sum[w] -= _ring[old];
+    }
+  }
+
+  // the same for the sums of the last 1, 2, 4, ... bins
+  for (w = 0 ; w < _n_dy ; w++)
+  {
+    m = 1u << w;
+    _dy_sum[w] += count;
+    if (_n_bins >= m)
+    {
+      old = _head + _size - m;
+      if (old >= _size)
+        old -= _size;
+      _dy_sum[w] -= _ring[old];
+    }
+  }
+
+  // the adaptive window grows up to the first window, then slides
+  _ad_sum += count;
+  if (_ad_n < _len[0])
+  {
+    _ad_n++;
+  }
+  else
+  {
+    old = _head + _size - _ad_n;
+    if (old >= _size)
+      old -= _size;
+    _ad_sum -= _ring[old];
+  }
+
+  _ring[_head] = count;
+  if (++_head >= _size)
+    _head = 0;
+  if (_n_bins < _size)
+    _n_bins++;
+
+  // shrink to the shortest of the last bins that departs from the rest
+  for (w = 0 ; w < _n_dy && (1u << w) < _ad_n ; w++)
+  {
+    if (changed(_dy_sum[w], 1u << w))
+    {
+      _ad_n = 1u << w;
+      _ad_sum = _dy_sum[w];
+      break;
+    }
+  }
+}
+
+// Test the k counts of the last m bins against the rate of the adaptive
+// window. The rate is estimated from the whole window, with the S counts
+// of the n other bins, the deviation k * n - m * S then has the variance
+// m * n * (S + k) for a Poisson process.
+byte CountWindows::changed(unsigned long k, unsigned int m)
+{
+  float n = _ad_n - m;
+  float S = _ad_sum - k;
+  float d = k * n - m * S;
+
+  return d * d > CW_ADAPT_Z2 * m * n * (S + k);
+}
+
+// Number of windows
+byte CountWindows::windows()
+{
+  return _n_win;
+}
+
+// Length of window w in seconds
+unsigned int CountWindows::length(byte w)
+{
+  return _len[w] * _bin_s;
+}
+
+// Counts in window w
+unsigned long CountWindows::sum(byte w)
+{
+  return _sum[w];
+}
+
+// Counts per minute in window w
+unsigned long CountWindows::cpm(byte w)
+{
+  return _sum[w] * _mul[w] / _div[w];
+}
+
+// Length of the adaptive window in seconds
+unsigned int CountWindows::adaptive_length()
+{
+  return _ad_n * _bin_s;
+}
+
+// Counts per minute in the adaptive window
+unsigned long CountWindows::adaptive_cpm()
+{
+  if (_ad_n == 0)
+    return 0;
+  return _ad_sum * 60 / (_ad_n * _bin_s);
+}
+
+// 1 when window w is covered by bins, length(w) seconds after reset()
+byte CountWindows::full(byte w)
+{
+  return _n_bins >= _len[w];
+}
@@ -0,0 +1,94 @@
+/*
+   Counts over several moving windows of count bins
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COUNTWINDOWS_H
+#define COUNTWINDOWS_H
+
+// Link to arduino library
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#define CW_WIN_MAX  3      // number of windows
+#define CW_BINS_MAX 240    // length of the longest window in bins
+#define CW_DY_MAX   8      // windows of 1, 2, 4, ... 128 bins for the adaptive window
+#define CW_ADAPT_Z2 16.0   // square of the deviation that makes the adaptive window shrink
+
+// Moving sums of the counts of the last bins over several windows
+// The windows share one ring of the last bins, as long as the longest
+// window. Each window keeps its running sum: the new bin is added and the
+// bin that leaves the window is taken out, so that a bin costs the same
+// whatever the length of the windows. Lengths are in seconds, the windows
+// are multiples of the bin, the first one is usually a minute.
+// The adaptive window follows a change of the count rate faster than the
+// first window. It grows by one bin at each bin, up to the first window.
+// At each bin, the last 1, 2, 4, ... bins are tested against the rest of
+// the adaptive window, if the counts are too far from the rate of the
+// window for a Poisson process, the window shrinks to these last bins.
+// The sums of the last 1, 2, 4, ... bins are running sums too, a bin costs
+// at most CW_DY_MAX of them and as many tests.
+class CountWindows
+{
+  public:
+    CountWindows();
+    static byte valid(unsigned int bin_s, const uint16_t *win_s);
+    byte setup(unsigned int bin_s, const uint16_t *win_s);
+    void reset();
+    void add(unsigned long count);
+    byte windows();
+    unsigned int length(byte w);
+    unsigned long sum(byte w);
+    unsigned long cpm(byte w);
+    byte full(byte w);
+    unsigned int adaptive_length();
+    unsigned long adaptive_cpm();
+
+  private:
+    unsigned long _ring[CW_BINS_MAX];
+    unsigned int _size;               // bins in the ring, the longest window
+    unsigned int _head;               // index of the next bin
+    unsigned int _n_bins;             // bins added since reset(), up to _size
+    byte _n_win;
+    unsigned int _len[CW_WIN_MAX];    // window lengths in bins
+    unsigned long _sum[CW_WIN_MAX];   // counts in the windows
+    byte _mul[CW_WIN_MAX];            // sum * _mul / _div is the CPM
+    unsigned int _div[CW_WIN_MAX];
+    unsigned int _bin_s;
+
+    // adaptive window
+    byte changed(unsigned long k, unsigned int m);
+    byte _n_dy;                       // sums of 1, 2, 4, ... bins, shorter than the first window
+    unsigned long _dy_sum[CW_DY_MAX];
+    unsigned int _ad_n;               // adaptive window length in bins
+    unsigned long _ad_sum;            // counts in the adaptive window
+};
+
+#endif /* COUNTWINDOWS_H */
@@ -29,48 +29,187 @@
 
 #include "GPS.h"
 #include <limits.h>
+#if GPS_RX_RING_ENABLE
+#include <avr/interrupt.h>
+#endif
 
-/* 'private' methods declarations */
-void parse_line_rmc(char **token);  // parse RMC sentence (from NMEA protocol)
-void parse_line_gga(char **token);  // parse GGA sentence (from NMEA protocol)
-void parse_datetime();              // parse date and time into correct data struct
+/* 'private' functions declarations */
+byte gps_sentence_id(char *hdr);    // identify sentence from its header field
+byte gps_talker_id(char *hdr);      // identify talker from its header field
+unsigned int gps_be16(byte *p);     // big endian 16 bit value
+unsigned long gps_be32(byte *p);    // big endian 32 bit value
+void gps_civil_from_days(unsigned long days, unsigned int *y, byte *m, byte *d);  // date of day from 1970
+unsigned int gps_le16(byte *p);     // little endian 16 bit value
+unsigned long gps_le32(byte *p);    // little endian 32 bit value
+void gps_copy_field(char *dst, char *src, byte sz);  // copy and terminate a field
+long gps_parse_coord(char *s, char hem);  // parse coordinate into microdegrees
+unsigned long gps_parse_time(char *s);    // parse hhmmss.sss into milliseconds
+unsigned int gps_parse_date(char *s);     // parse ddmmyy into packed date
+char gps_hex_digit(char c);         // value of hex digit, -1 if not a hex digit
+unsigned int gps_date_next(unsigned int date);  // packed date of the next day
+void gps_two_digits(char *s, byte v);           // format two digits number
+unsigned int gps_rx_stat(volatile unsigned int *cnt);  // atomic read of a counter
+byte gps_fix_near(int32_t lat, int32_t lon, uint32_t time, gps_fix_t *fix);  // fix within reach of a position
 
-/* state variables */
-byte _updating;
-HardwareSerial* _serial;      // The serial port used by GPS
-gps_t _gps_data;              // GPS data structure
-char *_line;                  // buffer to receive new line from serial
-byte _index;                  // current character index
-unsigned long _rx_time;       // Timestamp of received time
+/* sentence handlers */
+typedef struct
+{
+  char type[3];                   // sentence type, e.g. RMC
+  byte talkers;                   // GPS_TALKER_* accepted for this sentence
+  byte min_fields;                // index of the last field the handler reads
+} gps_handler_t;
 
-// Constructor
-// we need to provide the line buffer for RAM efficiency
-void gps_init(HardwareSerial *serial, char *line)
+// The handler of a sentence type sits in the slot given by the hash of
+// its three letters: ((c0 << 1) ^ c1 ^ c2) & 7. The hash is collision free
+// for the six types below, so the lookup is one index and one compare.
+// GpsParser::parse_sentence() calls the handler of the slot.
+#define GPS_HANDLER_SLOTS 8
+#define GPS_HANDLER_HASH(t) ((((t)[0] << 1) ^ (t)[1] ^ (t)[2]) & (GPS_HANDLER_SLOTS-1))
+#define GPS_HANDLER_NONE { { 0, 0, 0 }, 0, 0 }
+#define GPS_TALKER_GNSS (GPS_TALKER_GP | GPS_TALKER_GN)
+#define GPS_TALKER_ALL (GPS_TALKER_GP | GPS_TALKER_GN | GPS_TALKER_GL | GPS_TALKER_GA | GPS_TALKER_GB)
+
+const gps_handler_t gps_handlers[GPS_HANDLER_SLOTS] PROGMEM = {
+#if GPS_NMEA_GGA
+  { { 'G', 'G', 'A' }, GPS_TALKER_GNSS, 9 },    // 0
+#else
+  GPS_HANDLER_NONE,
+#endif
+#if GPS_NMEA_ZDA
+  { { 'Z', 'D', 'A' }, GPS_TALKER_GNSS, 4 },    // 1
+#else
+  GPS_HANDLER_NONE,
+#endif
+#if GPS_NMEA_RMC
+  { { 'R', 'M', 'C' }, GPS_TALKER_GNSS, 10 },   // 2
+#else
+  GPS_HANDLER_NONE,
+#endif
+#if GPS_NMEA_GSV
+  { { 'G', 'S', 'V' }, GPS_TALKER_ALL, 3 },     // 3
+#else
+  GPS_HANDLER_NONE,
+#endif
+#if GPS_NMEA_GSA
+  { { 'G', 'S', 'A' }, GPS_TALKER_ALL, 17 },    // 4
+#else
+  GPS_HANDLER_NONE,
+#endif
+  GPS_HANDLER_NONE,                                             // 5
+  GPS_HANDLER_NONE,                                             // 6
+#if GPS_NMEA_VTG
+  { { 'V', 'T', 'G' }, GPS_TALKER_GNSS, 7 },    // 7
+#else
+  GPS_HANDLER_NONE,
+#endif
+};
+
+#define GPS_SENTENCE_PMTK GPS_HANDLER_SLOTS  // MTK proprietary, $PMTKnnn
+#define GPS_SENTENCE_NONE 0xFF
+
+/* states of the streaming parser */
+#define GPS_ST_IDLE 0   // waiting for '$'
+#define GPS_ST_BODY 1   // receiving fields, computing checksum
+#define GPS_ST_SKIP 2   // sentence not parsed, waiting for end of line
+#define GPS_ST_CK1  3   // first checksum digit
+#define GPS_ST_CK2  4   // second checksum digit
+#define GPS_ST_EOL  5   // checksum received, waiting for end of line
+#define GPS_ST_MTK_SYNC 6   // MTK binary, 0x04 received, waiting for 0x24
+#define GPS_ST_MTK_LEN1 7   // MTK binary, low byte of frame length
+#define GPS_ST_MTK_LEN2 8   // MTK binary, high byte of frame length
+#define GPS_ST_MTK_BODY 9   // MTK binary, command and payload
+#define GPS_ST_MTK_CHK  10  // MTK binary, checksum
+#define GPS_ST_MTK_CR   11  // MTK binary, 0x0D
+#define GPS_ST_MTK_LF   12  // MTK binary, 0x0A
+#define GPS_ST_STQ_SYNC 13  // SkyTraq binary, 0xA0 received, waiting for 0xA1
+#define GPS_ST_STQ_LEN1 14  // SkyTraq binary, high byte of payload length
+#define GPS_ST_STQ_LEN2 15  // SkyTraq binary, low byte of payload length
+#define GPS_ST_STQ_BODY 16  // SkyTraq binary, message id and payload
+#define GPS_ST_STQ_CHK  17  // SkyTraq binary, checksum
+#define GPS_ST_STQ_CR   18  // SkyTraq binary, 0x0D
+#define GPS_ST_STQ_LF   19  // SkyTraq binary, 0x0A
+#define GPS_ST_UBX_SYNC 20  // UBX, 0xB5 received, waiting for 0x62
+#define GPS_ST_UBX_CLASS 21 // UBX, message class
+#define GPS_ST_UBX_ID   22  // UBX, message id
+#define GPS_ST_UBX_LEN1 23  // UBX, low byte of payload length
+#define GPS_ST_UBX_LEN2 24  // UBX, high byte of payload length
+#define GPS_ST_UBX_BODY 25  // UBX, payload
+#define GPS_ST_UBX_CKA  26  // UBX, first checksum byte
+#define GPS_ST_UBX_CKB  27  // UBX, second checksum byte
+
+/* states of the fix quality filter */
+#define GPS_FLT_NONE 0  // no fix accepted yet
+#define GPS_FLT_REF  1  // last accepted fix is the reference
+#define GPS_FLT_HELD 2  // a fix far from the reference is held
+
+#if GPS_RX_RING_ENABLE
+/* receive ring, filled from the timer interrupt */
+HardwareSerial *GpsRxRing::_port;
+volatile uint8_t GpsRxRing::_ring[GPS_RX_RING_SZ];
+volatile uint8_t GpsRxRing::_head;
+volatile uint8_t GpsRxRing::_tail;
+volatile unsigned int GpsRxRing::_dropped;
+volatile unsigned int GpsRxRing::_overrun;
+volatile unsigned long GpsRxRing::_last;
+volatile unsigned long GpsRxRing::_burst_time;
+volatile uint8_t GpsRxRing::_burst_pos;
+volatile uint8_t GpsRxRing::_burst_new;
+
+/* the receiver behind the gps_* functions */
+GpsRxRing _gps_ring;
+GpsReceiver<GpsRxRing> _gps;
+#else
+GpsReceiver<HardwareSerial> _gps;
+#endif
+
+// Start the parser, the line buffer receives the sentences and the frames
+void GpsParser::init(char *line)
 {
-  _serial = serial; // Hardware Serial connection, supposed to be initialized
   _index = 0;            // character counter initialization
   _updating = 0;    // not updating when starting (non-blocking)
   _line = line;     // the character array for serial com buffering
+  _state = GPS_ST_IDLE;  // wait for the beginning of a sentence
+  _cmd_count = 0;   // command queue is empty
+  _cmd_send = 0;
+  _cmd_status = 0;
+  _cmd_failures = 0;
+  _mtk_status = 0;
+  _bin_ack = 0;
+  _epoch_rx_new = 0;
+  _pps_new = 0;
+  _utc_valid = 0;
+  _utc_bin = GPS_UTC_BIN_NONE;
+  _trk_n = 0;
+  _trk_dist = 0;
+  _trk_last_valid = 0;
+  _pwr_auto = 0;
+  _pwr_mode = GPS_POWER_FULL;
+#if GPS_FILTER_ENABLE
+  _flt_state = GPS_FLT_NONE;
+#endif
+  _rx_truncated = 0;  // clear parse statistics
+  _rx_chk_errors = 0;
+#if GPS_NMEA_GSV
+  memset(_gsv_in_view, 0, sizeof(_gsv_in_view));
+#endif
 
   // set initial gps data to all zero
-  memset((void *)&_gps_data, 0, sizeof(gps_t));
-}
-
-// A simple wrapper to send commands to the GPS through serial
-void gps_send_command(char *cmd)
-{
-  _serial->println(cmd);
+  memset((void *)_gps_buf, 0, sizeof(_gps_buf));
+  _gps_data = &_gps_buf[0];
+  _gps_pub = &_gps_buf[GPS_EPOCH_BUFFER];
+  _gps_seq = 0;
+  _epoch_parts = 0;
 }
 
 // Availability indicator
-int gps_available()
+int GpsParser::available()
 {
   // location available when not updating
   return !_updating;
 }
 
 // Return the millisecond microprocessor time of when data was received
-unsigned long gps_age()
+unsigned long GpsParser::age()
 {
   unsigned long now = millis();
   
@@ -80,78 +219,410 @@ unsigned long gps_age()
     return (ULONG_MAX - _rx_time + now);
 }
 
-// Update routine
-void gps_update()
+// Drop the sentence being received, the port was flushed
+void GpsParser::restart()
 {
+  _state = GPS_ST_IDLE;
+}
 
-  char *tok[SYM_SZ] = {0};
-  int j = 0;
+// The GPS started to send the sentences of an epoch at time t (millis())
+void GpsParser::epoch_start(unsigned long t)
+{
+  _epoch_rx = t;
+  _epoch_rx_new = 1;
+}
 
-  while (_serial->available())
+// Queue a PMTK command stored in flash, e.g. command(PSTR(MTK_UPDATE_RATE_1HZ))
+// The receiver sends it once the previous ones are acknowledged.
+// returns 0 if the queue is full
+int GpsParser::command(const char *cmd)
+{
+  if (_cmd_count == GPS_CMD_QUEUE_SZ)
+    return 0;
+
+  _cmd_queue[(_cmd_head + _cmd_count) % GPS_CMD_QUEUE_SZ] = cmd;
+  _cmd_status |= GPS_CMD_PENDING;
+
+  // send right away if nothing is in flight
+  if (_cmd_count++ == 0)
+  {
+    _cmd_tries = 0;
+    _cmd_send = 1;
+  }
+
+  return 1;
+}
+
+// Status of the command queue, GPS_CMD_* flags
+// the ACKED and FAILED flags are cleared when read
+byte GpsParser::command_status()
+{
+  byte status = _cmd_status;
+  _cmd_status &= GPS_CMD_PENDING;
+  return status;
+}
+
+// The command at the head of the queue if it must be sent now, NULL otherwise
+// A command that was not acknowledged in time is retried or dropped.
+const char *GpsParser::command_due()
+{
+  if (_cmd_count == 0)
+    return NULL;
+
+  if (!_cmd_send && millis() - _cmd_time > GPS_CMD_TIMEOUT)
+  {
+    if (_cmd_tries < GPS_CMD_RETRY)
+      _cmd_send = 1;
+    else
+      command_done(GPS_CMD_FAILED);
+  }
+
+  return (_cmd_send) ? _cmd_queue[_cmd_head] : NULL;
+}
+
+// The command at the head of the queue was just sent
+// returns the new baud rate of the GPS if the command changes it, 0 otherwise
+unsigned long GpsParser::command_sent()
+{
+  const char *cmd = _cmd_queue[_cmd_head];
+  unsigned long baud = 0;
+  char c;
+
+  // command number, as in $PMTKnnn
+  _cmd_ack = (pgm_read_byte(cmd+5)-'0')*100 + (pgm_read_byte(cmd+6)-'0')*10 + (pgm_read_byte(cmd+7)-'0');
+
+  _cmd_time = millis();
+  _cmd_tries++;
+  _cmd_send = 0;
+
+  // restart commands and the switch to binary mode are not acknowledged
+  if ((_cmd_ack >= 101 && _cmd_ack <= 104) || _cmd_ack == 253)
+  {
+    command_done(GPS_CMD_ACKED);
+  }
+  // baud rate change is not acknowledged, the receiver follows the GPS
+  else if (_cmd_ack == 251)
+  {
+    cmd += 9;
+    while ((c = pgm_read_byte(cmd++)) >= '0' && c <= '9')
+      baud = 10*baud + (c - '0');
+    command_done(GPS_CMD_ACKED);
+  }
+
+  return baud;
+}
+
+// Remove the command at the head of the queue, the next one is sent
+void GpsParser::command_done(byte flags)
+{
+  if (flags & GPS_CMD_FAILED)
+    _cmd_failures++;
+  _cmd_status |= flags;
+
+  _cmd_head = (_cmd_head + 1) % GPS_CMD_QUEUE_SZ;
+  _cmd_tries = 0;
+
+  if (--_cmd_count > 0)
+    _cmd_send = 1;
+  else
+    _cmd_status &= ~GPS_CMD_PENDING;
+}
+
+// Number of commands waiting in the queue, including the one in flight
+byte GpsParser::command_pending()
+{
+  return _cmd_count;
+}
+
+// Number of commands that failed since init()
+byte GpsParser::command_failures()
+{
+  return _cmd_failures;
+}
+
+// Status of the MTK module, GPS_MTK_* flags
+byte GpsParser::mtk_status()
+{
+  return _mtk_status;
+}
+
+// Last ACK received in MTK binary mode
+// returns -1 if no new ACK was received, the ACK result flag otherwise.
+// cmd is the ACK message (MTK_BIN_ACK_CMD or MTK_BIN_ACK_EPO), id is the
+// acknowledged command or EPO sequence number.
+int GpsParser::mtk_bin_ack(unsigned int *cmd, unsigned int *id)
+{
+  if (!_bin_ack)
+    return -1;
+
+  _bin_ack = 0;
+  *cmd = _bin_ack_cmd;
+  *id = _bin_ack_id;
+  return _bin_ack_result;
+}
+
+// Feed one character to the parser
+// The checksum, the field splitting and the sentence type are all
+// worked out as the characters arrive so that the line is never re-scanned.
+// returns 1 when a valid sentence was just parsed, 0 otherwise
+int GpsParser::encode(char c)
+{
+  // binary frames can contain any byte, including '$' and '\n'
+#if GPS_UBX_ENABLE
+  if (_state >= GPS_ST_UBX_SYNC || (_state < GPS_ST_MTK_SYNC && (byte)c == UBX_SYNC0))
+    return encode_ubx(c);
+#endif
+#if GPS_SKYTRAQ_ENABLE
+  if (_state >= GPS_ST_STQ_SYNC || (_state < GPS_ST_MTK_SYNC && (byte)c == STQ_PREAMBLE0))
+    return encode_skytraq(c);
+#endif
+  if (_state >= GPS_ST_MTK_SYNC || c == MTK_BIN_PREAMBLE0)
+    return encode_mtk_bin(c);
+
+  // a dollar always starts a new sentence, even in the middle of a broken one
+  if (c == '$')
+  {
+    _line[0] = c;
+    _index = 1;
+    _chk = 0;
+    _nfld = 0;
+    _tok[0] = _line;
+    _sentence = GPS_SENTENCE_NONE;
+    _state = GPS_ST_BODY;
+    _updating = 1;
+    return 0;
+  }
+
+  // end of line closes whatever was being received
+  if (c == '\n')
   {
-    if (_index < LINE_SZ)
+    // set timestamp
+    _rx_time = millis();
+
+    // clear the flag so that we know its okay to read the data
+    _updating = 0;
+
+    // only a complete sentence with matching checksum is parsed
+    if (_state != GPS_ST_EOL || _chk != _chk_rx)
     {
-      _line[_index] = _serial->read();
-      if (_line[_index] == '\n')
-      {
-        // set timestamp
-        _rx_time = millis();
+      if (_state == GPS_ST_EOL)
+        _rx_chk_errors++;
+      _state = GPS_ST_IDLE;
+      return 0;
+    }
+    _state = GPS_ST_IDLE;
 
-        // terminate string with null character
-        _line[_index+1] = '\0';
-        
-        // reset character counter
-        _index=0;
+    // MTK messages are not in the handler table
+    if (_sentence == GPS_SENTENCE_PMTK)
+    {
+      parse_line_pmtk(_tok, _nfld);
+      return 1;
+    }
 
-        // dump the raw GPS data
-        //Serial.print(_line);
+    // a sentence without a comma, e.g. $GPTXT*4F, has no type
+    if (_sentence == GPS_SENTENCE_NONE)
+      return 0;
 
-        // verify the line is valid NMEA sentence
-        int L = strlen(_line);
-        int valid_sentence = gps_verify_NMEA_sentence(_line, L-2); // -2 is for \r\n
+    // call the handler if all the fields it reads were received
+    if (_nfld < pgm_read_byte(&gps_handlers[_sentence].min_fields))
+      return 0;
+    parse_sentence(_sentence, _tok);
 
-        // if the sentence is a valide sentence, try to parse it
-        if (valid_sentence)
-        {
-          // tokenize line
-          char *string;
+    return 1;
+  }
 
-          string = _line;
+  switch (_state)
+  {
+    case GPS_ST_BODY:
+      if (c == '*')
+      {
+        // terminate last field and get the checksum
+        _line[_index] = '\0';
+        _state = GPS_ST_CK1;
+        break;
+      }
 
-          while ((tok[j++] = strsep(&string, ",")) != NULL)
-            ;
+      _chk ^= c;
 
-          // reset the index variable for next run
-          j = 0;
+      if (c == ',')
+      {
+        // terminate field in place, like strsep would
+        _line[_index++] = '\0';
 
-          // parse line and date/time and update gps struct
-          if (strcmp(tok[0], "$GPRMC") == 0)
-          {
-            parse_line_rmc(tok);
-            parse_datetime();
-          }
-          else if (strcmp(tok[0], "$GPGGA") == 0)
+        // the sentence type is known as soon as the first field is done
+        if (_nfld == 0)
+        {
+          _sentence = gps_sentence_id(_tok[0]);
+          if (_sentence == GPS_SENTENCE_NONE)
           {
-             parse_line_gga(tok);
+            _state = GPS_ST_SKIP;
+            break;
           }
         }
-        
-        // clear the flag so that we know its okay to read the data
-        _updating = 0;
+
+        // open next field, drop sentences with too many fields
+        if (++_nfld >= SYM_SZ)
+        {
+          _state = GPS_ST_IDLE;
+          break;
+        }
+        _tok[_nfld] = _line + _index;
+      }
+      else if (c == '\r')
+      {
+        // end of line before the checksum
+        _state = GPS_ST_IDLE;
+        break;
       }
       else
       {
-        // still taking in data. increment index and make sure the updating flag is set
-        _updating = 1;
-        _index++;
+        _line[_index++] = c;
       }
-    }
-    else
+
+      // keep space for the terminating null character
+      if (_index >= LINE_SZ-1)
+      {
+        _rx_truncated++;
+        _state = GPS_ST_IDLE;
+      }
+      break;
+
+    case GPS_ST_CK1:
+      c = gps_hex_digit(c);
+      if (c < 0)
+      {
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _chk_rx = c << 4;
+      _state = GPS_ST_CK2;
+      break;
+
+    case GPS_ST_CK2:
+      c = gps_hex_digit(c);
+      if (c < 0)
+      {
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _chk_rx |= c;
+      _state = GPS_ST_EOL;
+      break;
+
+    case GPS_ST_EOL:
+      // only carriage return is expected before the end of line
+      if (c != '\r')
+        _state = GPS_ST_IDLE;
+      break;
+
+    default:
+      // idle or skipping sentence, ignore character
+      break;
+  }
+
+  return 0;
+}
+
+// Call the handler of the sentence in slot
+void GpsParser::parse_sentence(byte slot, char **token)
+{
+  switch (slot)
+  {
+#if GPS_NMEA_GGA
+    case 0:
+      parse_line_gga(token);
+      break;
+#endif
+#if GPS_NMEA_ZDA
+    case 1:
+      parse_line_zda(token);
+      break;
+#endif
+#if GPS_NMEA_RMC
+    case 2:
+      parse_line_rmc(token);
+      break;
+#endif
+#if GPS_NMEA_GSV
+    case 3:
+      parse_line_gsv(token);
+      break;
+#endif
+#if GPS_NMEA_GSA
+    case 4:
+      parse_line_gsa(token);
+      break;
+#endif
+#if GPS_NMEA_VTG
+    case 7:
+      parse_line_vtg(token);
+      break;
+#endif
+  }
+}
+
+// Identify the sentence from its header field, e.g. "$GPRMC"
+// returns the handler slot, or GPS_SENTENCE_NONE if not parsed
+byte gps_sentence_id(char *hdr)
+{
+  // MTK proprietary messages
+  if (hdr[1] == 'P' && hdr[2] == 'M' && hdr[3] == 'T' && hdr[4] == 'K')
+    return GPS_SENTENCE_PMTK;
+
+  // talker and type are two and three letters
+  if (hdr[1] == '\0' || hdr[2] == '\0' || hdr[3] == '\0'
+      || hdr[4] == '\0' || hdr[5] == '\0' || hdr[6] != '\0')
+    return GPS_SENTENCE_NONE;
+
+  byte slot = GPS_HANDLER_HASH(hdr+3);
+  const gps_handler_t *h = &gps_handlers[slot];
+
+  if (hdr[3] != (char)pgm_read_byte(&h->type[0])
+      || hdr[4] != (char)pgm_read_byte(&h->type[1])
+      || hdr[5] != (char)pgm_read_byte(&h->type[2]))
+    return GPS_SENTENCE_NONE;
+
+  if (!(gps_talker_id(hdr) & pgm_read_byte(&h->talkers)))
+    return GPS_SENTENCE_NONE;
+
+  return slot;
+}
+
+// Identify the talker from the header field, e.g. GPS_TALKER_GN for "$GNRMC"
+byte gps_talker_id(char *hdr)
+{
+  if (hdr[1] == 'G')
+  {
+    switch (hdr[2])
     {
-      _index = 0;
+      case 'P':
+        return GPS_TALKER_GP;
+      case 'N':
+        return GPS_TALKER_GN;
+      case 'L':
+        return GPS_TALKER_GL;
+      case 'A':
+        return GPS_TALKER_GA;
+      case 'B':
+        return GPS_TALKER_GB;
     }
   }
-  
+  else if (hdr[1] == 'B' && hdr[2] == 'D')
+  {
+    return GPS_TALKER_GB;
+  }
+
+  return 0;
+}
+
+// Value of an upper case hex digit, -1 if not a hex digit
+char gps_hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
 }
 
 // Compute checksum of input array
@@ -210,199 +681,1597 @@ int gps_verify_NMEA_sentence(char *sentence, int L)
 }
 
 // Return reference to GPS data structure
-gps_t *gps_getData() 
+gps_t *GpsParser::getData() 
 { 
-  return &_gps_data; 
+  return _gps_pub; 
 }
 
-// Parse RMC sentence
-void parse_line_rmc(char **token)
-{
-  // put all that to zero
-  memset(&_gps_data.utc,        0,     UTC_SZ-1);
-  memset(&_gps_data.status,     0,     DEFAULT_SZ-1);
-  memset(&_gps_data.lat,        0,     LAT_SZ-1);
-  memset(&_gps_data.lat_hem,    0,     DEFAULT_SZ-1);
-  memset(&_gps_data.lon,        0,     LON_SZ-1);
-  memset(&_gps_data.lon_hem,    0,     DEFAULT_SZ-1);
-  memset(&_gps_data.speed,      0,     SPD_SZ-1);
-  memset(&_gps_data.course,     0,     CRS_SZ-1);
-  memset(&_gps_data.date,       0,     DATE_SZ-1);
-  memset(&_gps_data.checksum,   0,     CKSUM_SZ-1);
-
-  // now if token is not NULL, copy into the GPS data structure
-  if (token[1][0] != 0)
-    memcpy(&_gps_data.utc,        token[1],     UTC_SZ-1);
-  if (token[2][0] != 0)
-    memcpy(&_gps_data.status,     token[2],     DEFAULT_SZ-1);
-  if (token[3][0] != 0)
-    memcpy(&_gps_data.lat,        token[3],     LAT_SZ-1);
-  if (token[4][0] != 0)
-    memcpy(&_gps_data.lat_hem,    token[4],     DEFAULT_SZ-1);
-  if (token[5][0] != 0)
-    memcpy(&_gps_data.lon,        token[5],     LON_SZ-1);
-  if (token[6][0] != 0)
-    memcpy(&_gps_data.lon_hem,    token[6],     DEFAULT_SZ-1);
-  if (token[7][0] != 0)
-    memcpy(&_gps_data.speed,      token[7],     SPD_SZ-1);
-  if (token[8][0] != 0)
-    memcpy(&_gps_data.course,     token[8],     CRS_SZ-1);
-  if (token[9][0] != 0)
-    memcpy(&_gps_data.date,       token[9],     DATE_SZ-1);
-  if (token[10][0] != 0)
-    memcpy(&_gps_data.checksum,   token[10],    CKSUM_SZ-1);
+// Return reference to the numeric fix data
+gps_fix_t *GpsParser::getFix()
+{
+  return &_gps_pub->fix;
 }
 
-// Parse GGA sentence
-void parse_line_gga(char **token)
-{
-    // set structure to zero
-    memset(&_gps_data.quality,    0, DEFAULT_SZ-1);
-    memset(&_gps_data.num_sat,    0, NUM_SAT_SZ-1);
-    memset(&_gps_data.precision,  0, PRECISION_SZ-1);
-    memset(&_gps_data.altitude,   0, ALTITUDE_SZ-1);
-    
-    // now copy data if present
-    if (token[6][0] != 0)
-      memcpy(&_gps_data.quality,    token[6], DEFAULT_SZ-1);
-    if (token[7][0] != 0)
-      memcpy(&_gps_data.num_sat,    token[7], NUM_SAT_SZ-1);
-    if (token[8][0] != 0)
-      memcpy(&_gps_data.precision,  token[8], PRECISION_SZ-1);
-    if (token[9][0] != 0)
-      memcpy(&_gps_data.altitude,   token[9], ALTITUDE_SZ-1);
+// Number of epochs published so far
+// A consumer that reads the data across calls to gps_update() compares it
+// before and after to know if the data it read belongs to the same epoch.
+unsigned int GpsParser::seq()
+{
+  return _gps_seq;
 }
 
-// Parse date and time from GPS and input in structure
-void parse_datetime()
+// Parse RMC sentence
+void GpsParser::parse_line_rmc(char **token)
 {
-    memset(&_gps_data.datetime, 0, sizeof(date_time_t));
+  // copy the fields, empty fields leave an empty string
+  gps_copy_field(_gps_data->utc,       token[1],   UTC_SZ);
+  gps_copy_field(_gps_data->status,    token[2],   DEFAULT_SZ);
+  gps_copy_field(_gps_data->lat,       token[3],   LAT_SZ);
+  gps_copy_field(_gps_data->lat_hem,   token[4],   DEFAULT_SZ);
+  gps_copy_field(_gps_data->lon,       token[5],   LON_SZ);
+  gps_copy_field(_gps_data->lon_hem,   token[6],   DEFAULT_SZ);
+  gps_copy_field(_gps_data->speed,     token[7],   SPD_SZ);
+  gps_copy_field(_gps_data->course,    token[8],   CRS_SZ);
+  gps_copy_field(_gps_data->date,      token[9],   DATE_SZ);
+  gps_copy_field(_gps_data->checksum,  token[10],  CKSUM_SZ);
 
-    // parse UTC time
-    memcpy(_gps_data.datetime.hour, &_gps_data.utc[0], 2);
-    memcpy(_gps_data.datetime.minute, &_gps_data.utc[2], 2);
-    memcpy(_gps_data.datetime.second, &_gps_data.utc[4], 2);
+  // numeric values
+  _gps_data->fix.time = gps_parse_time(token[1]);
+  _gps_data->fix.date = gps_parse_date(token[9]);
+  _gps_data->fix.lat = gps_parse_coord(token[3], token[4][0]);
+  _gps_data->fix.lon = gps_parse_coord(token[5], token[6][0]);
+  _gps_data->fix.speed = (uint16_t)(gps_parse_fixed(token[7], 2) * 5144 / 10000); // knots to cm/s
+  _gps_data->fix.course = (uint16_t)gps_parse_fixed(token[8], 2);
+  if (token[2][0] == 'A')
+    _gps_data->fix.status |= GPS_FIX_VALID;
+  else
+    _gps_data->fix.status &= ~GPS_FIX_VALID;
 
-    // parse UTC calendar
-    memcpy(_gps_data.datetime.day, &_gps_data.date[0], 2);
-    memcpy(_gps_data.datetime.month, &_gps_data.date[2], 2);
-    memcpy(_gps_data.datetime.year, &_gps_data.date[4], 2);
+  fix_done(token[1][0] != '\0');
+  epoch_add(GPS_EPOCH_RMC, _gps_data->fix.time);
 }
 
-// Gets next gps line, or up to N characters
-// This routine is blocking
-// returns 1 for success, 0 for failure (timeout or N reached)
-int gps_get_next_line(char *str, int N, int timeout)
+// Common end of the messages carrying the fix, RMC or binary navigation data
+void GpsParser::fix_done(byte has_time)
 {
-  int i = 0;
-  unsigned long now = millis();
-  while (1)
+  // date and time strings
+  parse_datetime();
+
+  // the first fix message of the epoch sets the UTC clock
+  if (has_time && _gps_data->fix.date != 0)
+    utc_update(_gps_data->fix.time, _gps_data->fix.date);
+}
+
+#if GPS_FILTER_ENABLE
+// Gate a valid fix on its quality and on the jump from the last accepted fix
+// returns 0 when the fix is accepted, GPS_FIX_REJECTED or GPS_FIX_HELD
+byte GpsParser::filter(gps_fix_t *fix)
+{
+  // HDOP and satellites are zero when the receiver does not give them
+  if (fix->hdop > GPS_FILTER_HDOP || (fix->num_sat != 0 && fix->num_sat < GPS_FILTER_MIN_SAT))
+    return GPS_FIX_REJECTED;
+
+  if (_flt_state != GPS_FLT_NONE && !gps_fix_near(_flt_lat, _flt_lon, _flt_time, fix))
   {
-    while (_serial->available())
+    // far from the reference, but a fix close to the held one means the
+    // receiver did move and the reference was the outlier
+    if (_flt_state != GPS_FLT_HELD || !gps_fix_near(_hold_lat, _hold_lon, _hold_time, fix))
     {
-      str[i] = _serial->read();
-      if (i == N || str[i] == '\n')
-        goto out;
-      i++;
+      _hold_lat = fix->lat;
+      _hold_lon = fix->lon;
+      _hold_time = fix->time;
+      _flt_state = GPS_FLT_HELD;
+      return GPS_FIX_HELD;
     }
-    if (millis() - now > timeout)
-      break;
   }
-out:
-  // terminate string
-  str[i+1] = 0;
-  // return error if did not terminate correctly
-  if (i == N || millis() - now >= timeout)
-    return 0;
-  else
-    return 1;
+
+  _flt_lat = fix->lat;
+  _flt_lon = fix->lon;
+  _flt_time = fix->time;
+  _flt_state = GPS_FLT_REF;
+  return 0;
 }
 
-void gps_diagnostics()
+// Is the fix within reach of a position at time, moving at GPS_FILTER_SPEED
+byte gps_fix_near(int32_t lat, int32_t lon, uint32_t time, gps_fix_t *fix)
 {
+  uint32_t dt = (fix->time + GPS_DAY_MS - time) % GPS_DAY_MS;
+  float dy = (fix->lat - lat) * 0.111195;  // microdegrees to meters
+  float dx = (fix->lon - lon) * 0.111195 * cos(fix->lat * (M_PI / 180e6));
+  float reach = dt * (GPS_FILTER_SPEED / 100000.0) + GPS_FILTER_DISTANCE;
 
-#define TIMEOUT 1000
-#define MAX_RETRY 5
-#define TMP_BUF_LEN 20
-
-  char msg[20];
-  char tmp[TMP_BUF_LEN+1];
-  char mtk_init_cmp[TMP_BUF_LEN+1];
-  char mtk_sys_cmp[TMP_BUF_LEN+1];
-  int mtk_init_stat = 0;
-  int mtk_sys_stat = 0;
-  int r = 0;
-  int n;
+  return dx * dx + dy * dy <= reach * reach;
+}
+#endif
 
-  // Testing for System Message
-  strcpy_P(mtk_init_cmp, PSTR(MTK_INIT_MSG));
-  strcpy_P(mtk_sys_cmp, PSTR(MTK_SYS_MSG));
+// Add a sentence to the epoch, and publish the data when the sentences of
+// the epoch are all received. They carry the same UTC time, a new time
+// starts a new epoch.
+void GpsParser::epoch_add(byte part, uint32_t time)
+{
+  if (time != _epoch_time)
+  {
+    _epoch_time = time;
+    _epoch_parts = 0;
+  }
 
-  // flush GPS serial
-  while (_serial->available())
-    _serial->read();
+  _epoch_parts |= part;
+  if ((_epoch_parts & GPS_EPOCH_ALL) == GPS_EPOCH_ALL)
+    publish();
+}
 
-  // hot restart GPS to catch init message
-  strcpy_P(tmp, PSTR(MTK_HOT_RESTART));
-  _serial->println(tmp);
+// Publish the parsed data
+// The fix is gated and aggregated here, once the RMC and GGA sentences of
+// the epoch are both in, as the filter needs the HDOP and satellites of
+// GGA and receivers send the two in either order. The two buffers are
+// then swapped, and the new parse buffer starts from the published data,
+// so that sentences not received in every epoch keep their last value.
+void GpsParser::publish()
+{
+  // gate the fix on its quality
+  _gps_data->fix.status &= ~(GPS_FIX_REJECTED | GPS_FIX_HELD);
+#if GPS_FILTER_ENABLE
+  if (_gps_data->fix.status & GPS_FIX_VALID)
+    _gps_data->fix.status |= filter(&_gps_data->fix);
+#endif
 
-  while (r < MAX_RETRY && (mtk_init_stat == 0 || mtk_sys_stat == 0))
+  // aggregate the accepted fixes of the bin
+  if ((_gps_data->fix.status & (GPS_FIX_VALID | GPS_FIX_REJECTED | GPS_FIX_HELD)) == GPS_FIX_VALID)
   {
-    // update number of time we ran the loop
-    r++;
+    track_add(&_gps_data->fix);
+    if (_pwr_auto)
+      motion_add(&_gps_data->fix);
+  }
+  else
+    _trk_last_valid = 0;
 
-    // get next GPS line
-    if (!gps_get_next_line(tmp, TMP_BUF_LEN, TIMEOUT))
-      continue;
+#if GPS_EPOCH_BUFFER
+  gps_t *p = _gps_pub;
+  _gps_pub = _gps_data;
+  _gps_data = p;
+  memcpy(_gps_data, _gps_pub, sizeof(gps_t));
+#endif
+  _gps_seq++;
+  _epoch_parts = 0;
+}
 
-    // check there is a '$' at beginning
-    n = 0;
-    while (n < TMP_BUF_LEN && tmp[n] != '$')
-      n++;
-    if (n == TMP_BUF_LEN)
-      continue;
+// Parse GGA sentence
+void GpsParser::parse_line_gga(char **token)
+{
+  // copy the fields, empty fields leave an empty string
+  gps_copy_field(_gps_data->quality,   token[6],   DEFAULT_SZ);
+  gps_copy_field(_gps_data->num_sat,   token[7],   NUM_SAT_SZ);
+  gps_copy_field(_gps_data->precision, token[8],   PRECISION_SZ);
+  gps_copy_field(_gps_data->altitude,  token[9],   ALTITUDE_SZ);
 
-    // if INIT not confirmed yet, check for it
-    if (!mtk_init_stat)
-      if (strncmp(mtk_init_cmp, tmp+n, strlen(mtk_init_cmp)) == 0)
-      {
-        mtk_init_stat = 1;
-        continue;
-      }
+  // numeric values
+  _gps_data->fix.quality = (uint8_t)gps_parse_fixed(token[6], 0);
+  _gps_data->fix.num_sat = (uint8_t)gps_parse_fixed(token[7], 0);
+  _gps_data->fix.hdop = (uint16_t)gps_parse_fixed(token[8], 2);
+  _gps_data->fix.altitude = gps_parse_fixed(token[9], 1);
 
-    // if SYS not confirmed yet, check for it
-    if (!mtk_sys_stat)
-      if (strncmp(mtk_sys_cmp, tmp+n, strlen(mtk_sys_cmp)) == 0)
-        mtk_sys_stat = 1;
-  }
+  epoch_add(GPS_EPOCH_GGA, gps_parse_time(token[1]));
+}
 
-  strcpy_P(msg, PSTR("GPS type MTK,"));
-  Serial.print(msg);
-  if (mtk_init_stat)
+// Parse MTK sentence with n+1 fields: ACK and startup messages
+void GpsParser::parse_line_pmtk(char **token, byte n)
+{
+  unsigned int type = (unsigned int)gps_parse_fixed(token[0]+5, 0);
+
+  if (type == 1 && n >= 2)
   {
-    strcpy_P(msg, PSTR("yes"));
-    Serial.println(msg);
+    // $PMTK001,cmd,flag ACK of the command in flight
+    // flag 3 is success, 2 is failure (retried), 0 and 1 are invalid/unsupported
+    if (_cmd_count == 0 || gps_parse_fixed(token[1], 0) != (long)_cmd_ack)
+      return;
+    if (token[2][0] == '3')
+      command_done(GPS_CMD_ACKED);
+    else if (token[2][0] != '2' || _cmd_tries >= GPS_CMD_RETRY)
+      command_done(GPS_CMD_FAILED);
+    else
+      _cmd_send = 1;
   }
-  else
+  else if (type == 10 && n >= 1)
   {
-    strcpy_P(msg, PSTR("no"));
-    Serial.println(msg);
+    // $PMTK010,001 system startup
+    if (gps_parse_fixed(token[1], 0) == 1)
+      _mtk_status |= GPS_MTK_STARTUP;
   }
-
-  strcpy_P(msg, PSTR("GPS system startup,"));
-  Serial.print(msg);
-  if (mtk_sys_stat)
+  else if (type == 11 && n >= 1)
   {
-    strcpy_P(msg, PSTR("yes"));
-    Serial.println(msg);
+    // $PMTK011,MTKGPS text output at startup
+    if (strcmp_P(token[1], PSTR("MTKGPS")) == 0)
+      _mtk_status |= GPS_MTK_INIT;
   }
-  else
+}
+
+// Receive MTK binary frames, one byte at a time
+// 0x04 0x24, frame length (2 bytes), command (2 bytes), payload,
+// XOR checksum of length to payload, 0x0D 0x0A. All values little endian.
+// returns 1 when a valid frame was just parsed, 0 otherwise
+int GpsParser::encode_mtk_bin(byte c)
+{
+  switch (_state)
   {
-    strcpy_P(msg, PSTR("no"));
-    Serial.println(msg);
+    case GPS_ST_MTK_SYNC:
+      _state = (c == MTK_BIN_PREAMBLE1) ? GPS_ST_MTK_LEN1 : GPS_ST_IDLE;
+      break;
+
+    case GPS_ST_MTK_LEN1:
+      _bin_len = c;
+      _chk = c;
+      _state = GPS_ST_MTK_LEN2;
+      break;
+
+    case GPS_ST_MTK_LEN2:
+      _chk ^= c;
+      // only short messages (ACKs) are received, the rest is dropped
+      if (c != 0 || _bin_len < MTK_BIN_OVERHEAD + 2 || _bin_len - MTK_BIN_OVERHEAD > LINE_SZ)
+      {
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _bin_len -= MTK_BIN_OVERHEAD;
+      _index = 0;
+      _state = GPS_ST_MTK_BODY;
+      break;
+
+    case GPS_ST_MTK_BODY:
+      _line[_index++] = c;
+      _chk ^= c;
+      if (_index == _bin_len)
+        _state = GPS_ST_MTK_CHK;
+      break;
+
+    case GPS_ST_MTK_CHK:
+      if (c != _chk)
+      {
+        _rx_chk_errors++;
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _state = GPS_ST_MTK_CR;
+      break;
+
+    case GPS_ST_MTK_CR:
+      _state = (c == '\r') ? GPS_ST_MTK_LF : GPS_ST_IDLE;
+      break;
+
+    case GPS_ST_MTK_LF:
+      _state = GPS_ST_IDLE;
+      if (c != '\n')
+        break;
+      parse_mtk_bin((byte *)_line, _index);
+      return 1;
+
+    default:
+      // the first preamble byte
+      _state = GPS_ST_MTK_SYNC;
+      break;
   }
 
+  return 0;
+}
+
+// Parse MTK binary message, n bytes of command and payload
+void GpsParser::parse_mtk_bin(byte *buf, byte n)
+{
+  unsigned int cmd = buf[0] | (buf[1] << 8);
+
+  // command ACK and EPO packet ACK: id (2 bytes), result flag (1 byte)
+  if ((cmd == MTK_BIN_ACK_CMD || cmd == MTK_BIN_ACK_EPO) && n >= 5)
+  {
+    _bin_ack_cmd = cmd;
+    _bin_ack_id = buf[2] | (buf[3] << 8);
+    _bin_ack_result = buf[4];
+    _bin_ack = 1;
+  }
 }
 
+#if GPS_SKYTRAQ_ENABLE
+// Receive SkyTraq binary frames, one byte at a time
+// 0xA0 0xA1, payload length (2 bytes), message id and payload, XOR checksum
+// of message id and payload, 0x0D 0x0A. All values big endian.
+// returns 1 when a valid frame was just parsed, 0 otherwise
+int GpsParser::encode_skytraq(byte c)
+{
+  switch (_state)
+  {
+    case GPS_ST_STQ_SYNC:
+      if (c != STQ_PREAMBLE1)
+      {
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _updating = 1;
+      _state = GPS_ST_STQ_LEN1;
+      break;
+
+    case GPS_ST_STQ_LEN1:
+      // all the messages received fit in the line buffer
+      _state = (c == 0) ? GPS_ST_STQ_LEN2 : GPS_ST_IDLE;
+      break;
+
+    case GPS_ST_STQ_LEN2:
+      if (c == 0 || c > LINE_SZ)
+      {
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _bin_len = c;
+      _chk = 0;
+      _index = 0;
+      _state = GPS_ST_STQ_BODY;
+      break;
+
+    case GPS_ST_STQ_BODY:
+      _line[_index++] = c;
+      _chk ^= c;
+      if (_index == _bin_len)
+        _state = GPS_ST_STQ_CHK;
+      break;
+
+    case GPS_ST_STQ_CHK:
+      if (c != _chk)
+      {
+        _rx_chk_errors++;
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _state = GPS_ST_STQ_CR;
+      break;
+
+    case GPS_ST_STQ_CR:
+      _state = (c == '\r') ? GPS_ST_STQ_LF : GPS_ST_IDLE;
+      break;
 
+    case GPS_ST_STQ_LF:
+      _state = GPS_ST_IDLE;
+      if (c != '\n')
+        break;
+      _rx_time = millis();
+      parse_skytraq((byte *)_line, _index);
+      _updating = 0;
+      return 1;
 
+    default:
+      // the first preamble byte
+      _state = GPS_ST_STQ_SYNC;
+      break;
+  }
+
+  // a broken frame does not block the data
+  if (_state == GPS_ST_IDLE)
+    _updating = 0;
+
+  return 0;
+}
+
+// Parse SkyTraq binary message, n bytes of message id and payload
+void GpsParser::parse_skytraq(byte *buf, byte n)
+{
+  if (buf[0] == STQ_NAV_DATA && n >= STQ_NAV_DATA_SZ)
+    parse_stq_nav(buf);
+}
+
+// Parse SkyTraq navigation data message
+//  1 fix mode, 2 satellites used, 3 GPS week, 5 time of week (1/100 s),
+//  9 latitude, 13 longitude (1e-7 degrees), 17 ellipsoid altitude,
+// 21 sea level altitude (cm), 25 GDOP, PDOP, HDOP, VDOP, TDOP (1/100),
+// 35 ECEF position (cm), 47 ECEF velocity (cm/s)
+void GpsParser::parse_stq_nav(byte *buf)
+{
+  byte mode = buf[1];   // 0 no fix, 1 2D, 2 3D, 3 3D with DGPS
+  unsigned int week = gps_be16(buf + 3);
+  unsigned long tow = gps_be32(buf + 5);
+  long lat = (int32_t)gps_be32(buf + 9);
+  long lon = (int32_t)gps_be32(buf + 13);
+  long alt = (int32_t)gps_be32(buf + 21);
+  float vx = (int32_t)gps_be32(buf + 47);
+  float vy = (int32_t)gps_be32(buf + 51);
+  float vz = (int32_t)gps_be32(buf + 55);
+  gps_fix_t *fix = &_gps_data->fix;
+
+  // time of day and date, the week is zero until the receiver knows the time
+  if (week != 0)
+  {
+    unsigned long s = week * 604800UL + tow / 100 - GPS_LEAP_SECONDS;
+    unsigned long t = s % 86400;
+
+    fix->time = t * 1000 + (tow % 100) * 10;
+    fix->date = gps_date_from_days(s / 86400 + 3657);  // GPS time starts on 1980-01-06
+  }
+  else
+  {
+    fix->time = 0;
+    fix->date = 0;
+  }
+
+  // position, rounded to microdegrees and decimeters
+  fix->lat = (lat + ((lat < 0) ? -5 : 5)) / 10;
+  fix->lon = (lon + ((lon < 0) ? -5 : 5)) / 10;
+  fix->altitude = (alt + ((alt < 0) ? -5 : 5)) / 10;
+
+  // quality of the fix
+  fix->num_sat = buf[2];
+  fix->pdop = gps_be16(buf + 27);
+  fix->hdop = gps_be16(buf + 29);
+  fix->vdop = gps_be16(buf + 31);
+  fix->fix_type = (mode == 0) ? 1 : (mode == 1) ? 2 : 3;
+  fix->quality = (mode == 0) ? 0 : (mode == 3) ? 2 : 1;
+  if (mode != 0)
+    fix->status |= GPS_FIX_VALID;
+  else
+    fix->status &= ~GPS_FIX_VALID;
+
+  // ECEF velocity rotated to east and north for speed and course over ground
+  float phi = lat * (M_PI / 180e7);
+  float lam = lon * (M_PI / 180e7);
+  float ve = cos(lam) * vy - sin(lam) * vx;
+  float vn = cos(phi) * vz - sin(phi) * (cos(lam) * vx + sin(lam) * vy);
+  float crs = atan2(ve, vn) * (18000 / M_PI);
+  if (crs < 0)
+    crs += 36000;
+  fix->speed = (uint16_t)(sqrt(ve * ve + vn * vn) + 0.5);
+  fix->course = (uint16_t)(crs + 0.5) % 36000;
+
+  fix_strings(week != 0);
+  fix_done(week != 0);
+  publish();
+}
+
+// Big endian 16 bit value
+unsigned int gps_be16(byte *p)
+{
+  return ((unsigned int)p[0] << 8) | p[1];
+}
+
+// Big endian 32 bit value
+unsigned long gps_be32(byte *p)
+{
+  return ((unsigned long)gps_be16(p) << 16) | gps_be16(p + 2);
+}
+#endif /* GPS_SKYTRAQ_ENABLE */
+
+#if GPS_UBX_ENABLE
+// Receive UBX frames, one byte at a time
+// 0xB5 0x62, class, id, payload length (2 bytes), payload, Fletcher
+// checksum of class to payload (2 bytes). All values little endian.
+// returns 1 when a valid frame was just parsed, 0 otherwise
+int GpsParser::encode_ubx(byte c)
+{
+  // the checksum covers class, id, length and payload, _chk and _chk_rx
+  // hold its two bytes
+  if (_state >= GPS_ST_UBX_CLASS && _state <= GPS_ST_UBX_BODY)
+  {
+    _chk += c;
+    _chk_rx += _chk;
+  }
+
+  switch (_state)
+  {
+    case GPS_ST_UBX_SYNC:
+      if (c != UBX_SYNC1)
+      {
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _updating = 1;
+      _chk = 0;
+      _chk_rx = 0;
+      _state = GPS_ST_UBX_CLASS;
+      break;
+
+    case GPS_ST_UBX_CLASS:
+      _ubx_class = c;
+      _state = GPS_ST_UBX_ID;
+      break;
+
+    case GPS_ST_UBX_ID:
+      _ubx_id = c;
+      _state = GPS_ST_UBX_LEN1;
+      break;
+
+    case GPS_ST_UBX_LEN1:
+      _bin_len = c;
+      _state = GPS_ST_UBX_LEN2;
+      break;
+
+    case GPS_ST_UBX_LEN2:
+      // all the messages received fit in the line buffer
+      if (c != 0 || _bin_len > LINE_SZ)
+      {
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _index = 0;
+      _state = (_bin_len == 0) ? GPS_ST_UBX_CKA : GPS_ST_UBX_BODY;
+      break;
+
+    case GPS_ST_UBX_BODY:
+      _line[_index++] = c;
+      if (_index == _bin_len)
+        _state = GPS_ST_UBX_CKA;
+      break;
+
+    case GPS_ST_UBX_CKA:
+      if (c != _chk)
+      {
+        _rx_chk_errors++;
+        _state = GPS_ST_IDLE;
+        break;
+      }
+      _state = GPS_ST_UBX_CKB;
+      break;
+
+    case GPS_ST_UBX_CKB:
+      _state = GPS_ST_IDLE;
+      if (c != _chk_rx)
+      {
+        _rx_chk_errors++;
+        break;
+      }
+      _rx_time = millis();
+      parse_ubx((byte *)_line, _index);
+      _updating = 0;
+      return 1;
+
+    default:
+      // the first sync character
+      _state = GPS_ST_UBX_SYNC;
+      break;
+  }
+
+  // a broken frame does not block the data
+  if (_state == GPS_ST_IDLE)
+    _updating = 0;
+
+  return 0;
+}
+
+// Parse UBX message of class _ubx_class and id _ubx_id, n bytes of payload
+void GpsParser::parse_ubx(byte *buf, byte n)
+{
+  if (_ubx_class != UBX_CLASS_NAV)
+    return;
+
+  if (_ubx_id == UBX_NAV_PVT && n >= UBX_NAV_PVT_SZ)
+    parse_ubx_pvt(buf);
+  else if (_ubx_id == UBX_NAV_DOP && n >= UBX_NAV_DOP_SZ)
+  {
+    // comes before NAV-PVT in the epoch, NAV-PVT has no HDOP
+    _gps_data->fix.hdop = gps_le16(buf + 12);
+    _gps_data->fix.vdop = gps_le16(buf + 10);
+  }
+}
+
+// Parse UBX NAV-PVT message
+//  4 year, month, day, hour, minute, second, 11 validity flags,
+// 16 fraction of second (ns, signed), 20 fix type, 21 fix flags,
+// 23 satellites used, 24 longitude, 28 latitude (1e-7 degrees),
+// 32 ellipsoid height, 36 sea level height (mm), 60 ground speed (mm/s),
+// 64 heading of motion (1e-5 degrees), 76 PDOP (1/100)
+void GpsParser::parse_ubx_pvt(byte *buf)
+{
+  byte valid = buf[11];
+  byte type = buf[20];  // 0 no fix, 1 dead reckoning, 2 2D, 3 3D, 4 3D and dead reckoning, 5 time
+  byte flags = buf[21];
+  long nano = (int32_t)gps_le32(buf + 16);
+  long lat = (int32_t)gps_le32(buf + 28);
+  long lon = (int32_t)gps_le32(buf + 24);
+  long alt = (int32_t)gps_le32(buf + 36);
+  long speed = (int32_t)gps_le32(buf + 60);
+  long heading = (int32_t)gps_le32(buf + 64);
+  byte has_time = (valid & UBX_PVT_VALID_TIME) != 0;
+  gps_fix_t *fix = &_gps_data->fix;
+
+  // time of day to the millisecond, the fraction is rounded to the
+  // nearest second by the receiver and can be negative
+  if (has_time)
+  {
+    long t = ((buf[8] * 60L + buf[9]) * 60 + buf[10]) * 1000 + nano / 1000000;
+    fix->time = (t < 0) ? 0 : (t >= (long)GPS_DAY_MS) ? GPS_DAY_MS - 1 : t;
+  }
+  else
+    fix->time = 0;
+  if (valid & UBX_PVT_VALID_DATE)
+    fix->date = GPS_DATE(gps_le16(buf + 4), buf[6], buf[7]);
+  else
+    fix->date = 0;
+
+  // position, rounded to microdegrees and decimeters
+  fix->lat = (lat + ((lat < 0) ? -5 : 5)) / 10;
+  fix->lon = (lon + ((lon < 0) ? -5 : 5)) / 10;
+  fix->altitude = (alt + ((alt < 0) ? -50 : 50)) / 100;
+
+  // quality of the fix
+  fix->num_sat = buf[23];
+  fix->pdop = gps_le16(buf + 76);
+  fix->fix_type = (type == 2) ? 2 : (type == 3 || type == 4) ? 3 : 1;
+  if ((flags & UBX_PVT_FIX_OK) && fix->fix_type > 1)
+  {
+    fix->status |= GPS_FIX_VALID;
+    fix->quality = (flags & UBX_PVT_DIFF) ? 2 : 1;
+  }
+  else
+  {
+    fix->status &= ~GPS_FIX_VALID;
+    fix->quality = 0;
+  }
+
+  // speed and course over ground
+  fix->speed = (uint16_t)((speed + 5) / 10);
+  fix->course = (uint16_t)(((heading + 500) / 1000) % 36000);
+
+  fix_strings(has_time);
+  fix_done(has_time);
+  publish();
+}
+
+// Little endian 16 bit value
+unsigned int gps_le16(byte *p)
+{
+  return p[0] | ((unsigned int)p[1] << 8);
+}
+
+// Little endian 32 bit value
+unsigned long gps_le32(byte *p)
+{
+  return gps_le16(p) | ((unsigned long)gps_le16(p + 2) << 16);
+}
+#endif /* GPS_UBX_ENABLE */
+
+#if GPS_SKYTRAQ_ENABLE || GPS_UBX_ENABLE
+// Write the strings of the binary fix in the NMEA format, so that the data
+// looks the same as with RMC and GGA
+void GpsParser::fix_strings(byte has_time)
+{
+  gps_fix_t *fix = &_gps_data->fix;
+  unsigned long t = fix->time / 1000;
+  unsigned long knots = (fix->speed * 10000UL + 2572) / 5144;  // knots x100
+
+  if (has_time)
+  {
+    gps_two_digits(_gps_data->utc, t / 3600);
+    gps_two_digits(_gps_data->utc + 2, (t / 60) % 60);
+    gps_two_digits(_gps_data->utc + 4, t % 60);
+    _gps_data->utc[6] = '.';
+    gps_two_digits(_gps_data->utc + 7, (fix->time % 1000) / 10);
+  }
+  else
+    _gps_data->utc[0] = '\0';
+
+  if (fix->date != 0)
+  {
+    gps_two_digits(_gps_data->date, GPS_DATE_DAY(fix->date));
+    gps_two_digits(_gps_data->date + 2, GPS_DATE_MONTH(fix->date));
+    gps_two_digits(_gps_data->date + 4, GPS_DATE_YEAR(fix->date) % 100);
+  }
+  else
+    _gps_data->date[0] = '\0';
+
+  gps_format_coord(_gps_data->lat, fix->lat, 2);
+  gps_format_coord(_gps_data->lon, fix->lon, 3);
+  _gps_data->lat_hem[0] = (fix->lat < 0) ? 'S' : 'N';
+  _gps_data->lon_hem[0] = (fix->lon < 0) ? 'W' : 'E';
+  snprintf_P(_gps_data->altitude, ALTITUDE_SZ, PSTR("%s%ld.%ld"), (fix->altitude < 0) ? "-" : "",
+      labs(fix->altitude) / 10, labs(fix->altitude) % 10);
+
+  _gps_data->status[0] = (fix->status & GPS_FIX_VALID) ? 'A' : 'V';
+  _gps_data->quality[0] = '0' + fix->quality;
+  snprintf_P(_gps_data->num_sat, NUM_SAT_SZ, PSTR("%u"), fix->num_sat);
+  snprintf_P(_gps_data->precision, PRECISION_SZ, PSTR("%u.%02u"), fix->hdop / 100, fix->hdop % 100);
+  snprintf_P(_gps_data->speed, SPD_SZ, PSTR("%lu.%02lu"), knots / 100, knots % 100);
+  snprintf_P(_gps_data->course, CRS_SZ, PSTR("%u.%02u"), fix->course / 100, fix->course % 100);
+}
+#endif
+
+#if GPS_NMEA_GSA
+// Parse GSA sentence
+void GpsParser::parse_line_gsa(char **token)
+{
+  _gps_data->fix.fix_type = (uint8_t)gps_parse_fixed(token[2], 0);
+  _gps_data->fix.pdop = (uint16_t)gps_parse_fixed(token[15], 2);
+  _gps_data->fix.vdop = (uint16_t)gps_parse_fixed(token[17], 2);
+}
+#endif
+
+#if GPS_NMEA_GSV
+// Parse GSV sentence
+// each constellation sends its own GSV group, the total in view is their sum
+void GpsParser::parse_line_gsv(char **token)
+{
+  byte talker = gps_talker_id(token[0]);
+  byte i = 0;
+
+  // first message of the group only
+  if (gps_parse_fixed(token[2], 0) != 1)
+    return;
+
+  while (!(talker & 1))
+  {
+    talker >>= 1;
+    i++;
+  }
+  _gsv_in_view[i] = (uint8_t)gps_parse_fixed(token[3], 0);
+
+  _gps_data->fix.sat_view = 0;
+  for (i = 0 ; i < 5 ; i++)
+    _gps_data->fix.sat_view += _gsv_in_view[i];
+}
+#endif
+
+#if GPS_NMEA_VTG
+// Parse VTG sentence
+void GpsParser::parse_line_vtg(char **token)
+{
+  _gps_data->fix.course = (uint16_t)gps_parse_fixed(token[1], 2);
+  _gps_data->fix.speed = (uint16_t)(gps_parse_fixed(token[7], 2) * 10 / 36);  // km/h to cm/s
+}
+#endif
+
+#if GPS_NMEA_ZDA
+// Parse ZDA sentence
+// unlike RMC, ZDA gives the year with four digits
+void GpsParser::parse_line_zda(char **token)
+{
+  _gps_data->fix.time = gps_parse_time(token[1]);
+  _gps_data->fix.date = GPS_DATE(gps_parse_fixed(token[4], 0),
+      gps_parse_fixed(token[3], 0), gps_parse_fixed(token[2], 0));
+}
+#endif
+
+// Copy a field of at most sz-1 characters and terminate it
+void gps_copy_field(char *dst, char *src, byte sz)
+{
+  while (--sz && *src != '\0')
+    *dst++ = *src++;
+  *dst = '\0';
+}
+
+// Parse a decimal number into an integer scaled by 10^dec
+// extra decimals are truncated, an empty string gives zero
+long gps_parse_fixed(char *s, byte dec)
+{
+  long v = 0;
+  byte neg = 0;
+  byte frac = 0;
+  byte point = 0;
+
+  if (*s == '-')
+  {
+    neg = 1;
+    s++;
+  }
+
+  for ( ; *s != '\0' ; s++)
+  {
+    if (*s == '.')
+    {
+      point = 1;
+      continue;
+    }
+    if (*s < '0' || *s > '9')
+      break;
+    if (point)
+    {
+      // ignore digits beyond the requested precision
+      if (frac == dec)
+        continue;
+      frac++;
+    }
+    v = 10*v + (*s - '0');
+  }
+
+  // scale if less decimals than requested were given
+  for ( ; frac < dec ; frac++)
+    v *= 10;
+
+  return (neg) ? -v : v;
+}
+
+// Parse NMEA coordinate (d)ddmm.mmmm and hemisphere into microdegrees
+long gps_parse_coord(char *s, char hem)
+{
+  // degrees and minutes with five decimals, e.g. 461894240 for 4618.9424
+  long v = gps_parse_fixed(s, 5);
+  long deg = v / 10000000L;
+
+  // minutes with five decimals to microdegrees is *1e6/60/1e5, i.e. /6
+  v = deg * 1000000L + (v - deg * 10000000L + 3) / 6;
+
+  return (hem == 'S' || hem == 'W') ? -v : v;
+}
+
+// Parse NMEA time hhmmss.sss into milliseconds since midnight
+unsigned long gps_parse_time(char *s)
+{
+  if (strlen(s) < 6)
+    return 0;
+
+  return ((s[0]-'0')*10 + (s[1]-'0')) * 3600000UL
+    + ((s[2]-'0')*10 + (s[3]-'0')) * 60000UL
+    + gps_parse_fixed(s+4, 3);
+}
+
+// Parse NMEA date ddmmyy into packed date
+// two digits years from 80 are in the 20th century (MTK default is 1980)
+unsigned int gps_parse_date(char *s)
+{
+  if (strlen(s) < 6)
+    return 0;
+
+  unsigned int yy = (s[4]-'0')*10 + (s[5]-'0');
+  unsigned int mm = (s[2]-'0')*10 + (s[3]-'0');
+  unsigned int dd = (s[0]-'0')*10 + (s[1]-'0');
+
+  return GPS_DATE((yy >= 80) ? 1900 + yy : 2000 + yy, mm, dd);
+}
+
+// Parse date and time from GPS and input in structure
+void GpsParser::parse_datetime()
+{
+    memset(&_gps_data->datetime, 0, sizeof(date_time_t));
+
+    // parse UTC time
+    memcpy(_gps_data->datetime.hour, &_gps_data->utc[0], 2);
+    memcpy(_gps_data->datetime.minute, &_gps_data->utc[2], 2);
+    memcpy(_gps_data->datetime.second, &_gps_data->utc[4], 2);
+
+    // parse UTC calendar
+    memcpy(_gps_data->datetime.day, &_gps_data->date[0], 2);
+    memcpy(_gps_data->datetime.month, &_gps_data->date[2], 2);
+    memcpy(_gps_data->datetime.year, &_gps_data->date[4], 2);
+}
+
+// Call from the interrupt routine of the rising edge of the GPS 1PPS output
+// The pulse marks the exact start of the UTC second reported by the next RMC.
+void GpsParser::pps()
+{
+  _pps_time = millis();
+  _pps_new = 1;
+}
+
+// Set the UTC clock from a RMC sentence
+// The reference is the start of the burst of sentences of that epoch, or
+// better, the PPS pulse that came just before it.
+void GpsParser::utc_update(unsigned long time, unsigned int date)
+{
+  unsigned long pps;
+  uint8_t pps_new;
+  uint8_t oldSREG;
+
+  if (!_epoch_rx_new)
+    return;
+  _epoch_rx_new = 0;
+
+  oldSREG = SREG;
+  cli();
+  pps = _pps_time;
+  pps_new = _pps_new;
+  _pps_new = 0;
+  SREG = oldSREG;
+
+  if (pps_new && _epoch_rx - pps < 1000)
+  {
+    _utc_ref_ms = time - time % 1000;
+    _utc_ref_time = pps;
+  }
+  else
+  {
+    _utc_ref_ms = time;
+    _utc_ref_time = _epoch_rx;
+  }
+  _utc_ref_date = date;
+  _utc_valid = 1;
+}
+
+// Detect the edges of bins of period ms aligned on UTC time
+// period must divide a day, e.g. 5000 for bins starting at 0 and 5 seconds.
+// returns 1 when a new bin started and sets edge to the time of the edge in
+// seconds from 1970-01-01, 0 when in the same bin, -1 when the UTC time is
+// unknown.
+int GpsParser::utc_bin_edge(unsigned long period, unsigned long *edge)
+{
+  unsigned long now = millis();
+  unsigned long nbins = GPS_DAY_MS / period;
+  unsigned long t, bin, diff;
+  unsigned int date;
+
+  if (!_utc_valid || now - _utc_ref_time > GPS_UTC_HOLDOVER)
+  {
+    _utc_bin = GPS_UTC_BIN_NONE;
+    return -1;
+  }
+
+  // extrapolate UTC time, across midnight if needed
+  t = _utc_ref_ms + (now - _utc_ref_time);
+  date = _utc_ref_date;
+  while (t >= GPS_DAY_MS)
+  {
+    t -= GPS_DAY_MS;
+    date = gps_date_next(date);
+  }
+  bin = t / period;
+
+  // the first bin is not complete
+  if (_utc_bin == GPS_UTC_BIN_NONE)
+  {
+    _utc_bin = bin;
+    return 0;
+  }
+
+  // only move forward, a new reference can pull the clock back a few ms
+  diff = (bin + nbins - _utc_bin) % nbins;
+  if (diff == 0 || diff > nbins / 2)
+    return 0;
+  _utc_bin = bin;
+
+  *edge = gps_utc_seconds(date, bin * period);
+
+  return 1;
+}
+
+// UTC time now, in seconds from 1970-01-01
+// The clock set by the last fix is advanced with millis() in between.
+// returns 0 when the time is not known
+unsigned long GpsParser::utc_now()
+{
+  return utc_at(millis());
+}
+
+// UTC time at millis() time ms, in seconds from 1970-01-01
+// ms can be a little before the last fix, e.g. the end of a count bin
+// latched before the fix was parsed.
+// returns 0 when the time is not known
+unsigned long GpsParser::utc_at(unsigned long ms)
+{
+  long d = (long)(ms - _utc_ref_time);
+  long t;
+  unsigned long s;
+
+  if (!_utc_valid || d > (long)GPS_UTC_HOLDOVER || d < -(long)GPS_UTC_HOLDOVER)
+    return 0;
+
+  // time of day in ms, negative before midnight of the reference date
+  t = (long)_utc_ref_ms + d;
+  s = gps_utc_seconds(_utc_ref_date, 0);
+  if (t < 0)
+    return s - (999 - t) / 1000;
+  return s + t / 1000;
+}
+
+// millis() time of the next edge of bins of period ms aligned on UTC time
+// period must divide a day, as for utc_bin_edge(). This is used to move
+// the bins closed by the counter interrupt onto UTC time.
+// returns 1 and sets ms, 0 when the UTC time is unknown
+int GpsParser::utc_next_edge(unsigned long period, unsigned long *ms)
+{
+  unsigned long now = millis();
+  unsigned long t;
+
+  if (!_utc_valid || now - _utc_ref_time > GPS_UTC_HOLDOVER)
+    return 0;
+
+  // period divides a day, the day count does not matter
+  t = (_utc_ref_ms + (now - _utc_ref_time)) % period;
+  *ms = now + (period - t);
+
+  return 1;
+}
+
+// Seconds from 1970-01-01 of a packed date and a time of day in ms
+// The time can go past the end of the day.
+unsigned long gps_utc_seconds(unsigned int date, unsigned long ms)
+{
+  if (date == 0)
+    return ms / 1000;
+
+  return gps_days_from_civil(GPS_DATE_YEAR(date), GPS_DATE_MONTH(date), GPS_DATE_DAY(date)) * 86400
+    + ms / 1000;
+}
+
+// Days from 1970-01-01 of a date of the Gregorian calendar
+// The year starts in March so that the leap day is the last day of the year.
+unsigned long gps_days_from_civil(unsigned int y, byte m, byte d)
+{
+  y -= (m <= 2);
+  unsigned long era = y / 400;
+  unsigned int yoe = y - era * 400;                            // [0, 399]
+  unsigned int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;  // [0, 365]
+  unsigned long doe = yoe * 365UL + yoe / 4 - yoe / 100 + doy; // [0, 146096]
+
+  return era * 146097 + doe - 719468;
+}
+
+// Date of the day counted from 1970-01-01, the reverse of gps_days_from_civil()
+void gps_civil_from_days(unsigned long days, unsigned int *y, byte *m, byte *d)
+{
+  unsigned long z = days + 719468;  // days from 0000-03-01
+  unsigned long era = z / 146097;
+  unsigned long doe = z - era * 146097;
+  unsigned long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned long mp = (5 * doy + 2) / 153;
+
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = (mp < 10) ? mp + 3 : mp - 9;
+  *y = yoe + era * 400 + (*m <= 2);
+}
+
+// Packed date of the day counted from 1970-01-01
+unsigned int gps_date_from_days(unsigned long days)
+{
+  unsigned int y;
+  byte m, d;
+
+  gps_civil_from_days(days, &y, &m, &d);
+  return GPS_DATE(y, m, d);
+}
+
+// Write seconds from 1970-01-01 as ISO 8601 YYYY-MM-DDThh:mm:ssZ
+// buf holds at least GPS_ISO8601_SZ characters. returns the length.
+byte gps_iso8601(char *buf, unsigned long t)
+{
+  unsigned long s = t % 86400;
+  unsigned int y;
+  byte m, d;
+
+  gps_civil_from_days(t / 86400, &y, &m, &d);
+  gps_two_digits(buf, y / 100);
+  gps_two_digits(buf + 2, y % 100);
+  buf[4] = '-';
+  gps_two_digits(buf + 5, m);
+  buf[7] = '-';
+  gps_two_digits(buf + 8, d);
+  buf[10] = 'T';
+  gps_two_digits(buf + 11, s / 3600);
+  buf[13] = ':';
+  gps_two_digits(buf + 14, (s / 60) % 60);
+  buf[16] = ':';
+  gps_two_digits(buf + 17, s % 60);
+  buf[19] = 'Z';
+  buf[20] = '\0';
+
+  return GPS_ISO8601_SZ - 1;
+}
+
+// Packed date of the day after
+unsigned int gps_date_next(unsigned int date)
+{
+  static const byte mdays[12] PROGMEM = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  unsigned int y = GPS_DATE_YEAR(date);
+  byte m = GPS_DATE_MONTH(date);
+  byte d = GPS_DATE_DAY(date);
+  byte n;
+
+  if (m < 1 || m > 12)
+    return date;
+
+  n = pgm_read_byte(&mdays[m-1]);
+  if (m == 2 && y % 4 == 0)   // good from 1901 to 2099
+    n++;
+
+  if (++d > n)
+  {
+    d = 1;
+    if (++m > 12)
+    {
+      m = 1;
+      y++;
+    }
+  }
+
+  return GPS_DATE(y, m, d);
+}
+
+// Add a valid fix to the aggregate of the bin
+// The distance is integrated from the speed over ground, it does not grow
+// with the position noise when standing still.
+void GpsParser::track_add(gps_fix_t *fix)
+{
+  if (_trk_n == 0)
+  {
+    _trk_lat0 = fix->lat;
+    _trk_lon0 = fix->lon;
+    _trk_dlat = 0;
+    _trk_dlon = 0;
+    _trk_alt_min = fix->altitude;
+    _trk_alt_max = fix->altitude;
+  }
+  else
+  {
+    _trk_dlat += fix->lat - _trk_lat0;
+    _trk_dlon += fix->lon - _trk_lon0;
+    if (fix->altitude < _trk_alt_min)
+      _trk_alt_min = fix->altitude;
+    if (fix->altitude > _trk_alt_max)
+      _trk_alt_max = fix->altitude;
+  }
+
+  if (_trk_last_valid)
+  {
+    uint32_t dt = (fix->time + GPS_DAY_MS - _trk_last_time) % GPS_DAY_MS;
+    if (dt <= GPS_TRACK_MAX_DT)
+      _trk_dist += (uint32_t)fix->speed * dt;
+  }
+  _trk_last_time = fix->time;
+  _trk_last_valid = 1;
+
+  if (_trk_n < 0xFFFF)
+    _trk_n++;
+}
+
+// Get the aggregate of the fixes since the last call, and start a new one
+void GpsParser::track_get(gps_track_t *track)
+{
+  track->n_fix = _trk_n;
+  track->distance = (_trk_dist + 500) / 1000;
+
+  if (_trk_n > 0)
+  {
+    track->lat = _trk_lat0 + _trk_dlat / (int32_t)_trk_n;
+    track->lon = _trk_lon0 + _trk_dlon / (int32_t)_trk_n;
+    track->alt_min = _trk_alt_min;
+    track->alt_max = _trk_alt_max;
+  }
+  else
+  {
+    track->lat = 0;
+    track->lon = 0;
+    track->alt_min = 0;
+    track->alt_max = 0;
+  }
+
+  _trk_n = 0;
+  _trk_dist = 0;
+}
+
+// Let the stationarity detector set the power mode of the receiver
+// Enabling starts at full power and clears the time spent in each mode,
+// call it again when the receiver was powered up.
+void GpsParser::power_auto(byte enable)
+{
+  if (enable)
+  {
+    _pwr_mode = GPS_POWER_FULL;
+    _pwr_ms[GPS_POWER_FULL] = 0;
+    _pwr_ms[GPS_POWER_LOW] = 0;
+    _pwr_since = millis();
+    _still_since = _pwr_since;
+    _still_lat = 0;
+    _still_lon = 0;
+  }
+  else if (_pwr_mode == GPS_POWER_LOW && command(PSTR(MTK_NORMAL_MODE)))
+    power_set(GPS_POWER_FULL);
+
+  _pwr_auto = enable;
+}
+
+// Current power mode, GPS_POWER_FULL or GPS_POWER_LOW
+byte GpsParser::power_mode()
+{
+  return _pwr_mode;
+}
+
+// Percentage of the time spent in low power mode since gps_power_auto(1)
+byte GpsParser::power_low_share()
+{
+  unsigned long low = _pwr_ms[GPS_POWER_LOW];
+  unsigned long total = _pwr_ms[GPS_POWER_FULL] + low + (millis() - _pwr_since);
+
+  if (_pwr_mode == GPS_POWER_LOW)
+    low += millis() - _pwr_since;
+  if (total < 100)
+    return 0;
+
+  return low / (total / 100);
+}
+
+// Feed a valid fix to the stationarity detector
+// The receiver is still while the speed is low and the position stays
+// close to where it stopped. The position noise of a still receiver is a
+// few meters, well under GPS_STILL_DISTANCE.
+void GpsParser::motion_add(gps_fix_t *fix)
+{
+  unsigned long now = millis();
+  float dy = (fix->lat - _still_lat) * 0.111195;  // microdegrees to meters
+  float dx = (fix->lon - _still_lon) * 0.111195 * cos(fix->lat * (M_PI / 180e6));
+
+  if (fix->speed > GPS_STILL_SPEED || dx * dx + dy * dy > (float)GPS_STILL_DISTANCE * GPS_STILL_DISTANCE)
+  {
+    // moving, this is where it may stop next
+    _still_lat = fix->lat;
+    _still_lon = fix->lon;
+    _still_since = now;
+    if (_pwr_mode == GPS_POWER_LOW && command(PSTR(MTK_NORMAL_MODE)))
+      power_set(GPS_POWER_FULL);
+  }
+  else if (_pwr_mode == GPS_POWER_FULL && now - _still_since > GPS_STILL_TIME)
+  {
+    if (command(PSTR(GPS_LOW_POWER_MODE)))
+      power_set(GPS_POWER_LOW);
+  }
+}
+
+// Change the power mode and count the time spent in the previous one
+void GpsParser::power_set(byte mode)
+{
+  unsigned long now = millis();
+
+  _pwr_ms[_pwr_mode] += now - _pwr_since;
+  _pwr_since = now;
+  _pwr_mode = mode;
+}
+
+// Format microdegrees as NMEA ddmm.mmmm, or dddmm.mmmm with deg_digits = 3
+// The hemisphere is given by the sign of v.
+void gps_format_coord(char *buf, long v, byte deg_digits)
+{
+  unsigned long a = (v < 0) ? -v : v;
+  unsigned long deg = a / 1000000;
+  unsigned long mmin = ((a % 1000000) * 6 + 5) / 10;  // 1/10000 minutes
+
+  if (mmin >= 600000)
+  {
+    mmin -= 600000;
+    deg++;
+  }
+
+  if (deg_digits == 3)
+    sprintf_P(buf, PSTR("%03lu%02lu.%04lu"), deg, mmin / 10000, mmin % 10000);
+  else
+    sprintf_P(buf, PSTR("%02lu%02lu.%04lu"), deg, mmin / 10000, mmin % 10000);
+}
+
+// Write a two digits number and terminate the string
+void gps_two_digits(char *s, byte v)
+{
+  s[0] = '0' + v / 10;
+  s[1] = '0' + v % 10;
+  s[2] = '\0';
+}
+
+// Get the parse statistics, the receive ones are counted by the port
+void GpsParser::get_stats(gps_stats_t *stats)
+{
+  stats->dropped = 0;
+  stats->overrun = 0;
+  stats->truncated = _rx_truncated;
+  stats->chk_errors = _rx_chk_errors;
+}
+
+/* gps_* functions, on the receiver _gps */
+
+// Constructor
+// we need to provide the line buffer for RAM efficiency
+void gps_init(HardwareSerial *serial, char *line)
+{
+#if GPS_RX_RING_ENABLE
+  GpsRxRing::attach(serial);
+  _gps.begin(&_gps_ring, line);
+#else
+  _gps.begin(serial, line);
+#endif
+}
+
+void gps_send_command(char *cmd)
+{
+  _gps.send_command(cmd);
+}
+
+int gps_command(const char *cmd)
+{
+  return _gps.command(cmd);
+}
+
+byte gps_command_status()
+{
+  return _gps.command_status();
+}
+
+byte gps_command_pending()
+{
+  return _gps.command_pending();
+}
+
+byte gps_mtk_status()
+{
+  return _gps.mtk_status();
+}
+
+void gps_send_bytes(const byte *buf, int n)
+{
+  _gps.send_bytes(buf, n);
+}
+
+int gps_mtk_bin_ack(unsigned int *cmd, unsigned int *id)
+{
+  return _gps.mtk_bin_ack(cmd, id);
+}
+
+void gps_send_message(const uint8_t *msg, uint16_t len)
+{
+  _gps.send_message(msg, len);
+}
+
+void gps_ubx_send(byte cls, byte id, const byte *payload, uint16_t len)
+{
+  _gps.ubx_send(cls, id, payload, len);
+}
+
+void gps_ubx_nmea_off()
+{
+  _gps.ubx_nmea_off();
+}
+
+void gps_update()
+{
+  _gps.update();
+}
+
+void gps_flush()
+{
+  _gps.flush();
+}
+
+int gps_encode(char c)
+{
+  return _gps.encode(c);
+}
+
+int gps_available()
+{
+  return _gps.available();
+}
+
+gps_t *gps_getData()
+{
+  return _gps.getData();
+}
+
+gps_fix_t *gps_getFix()
+{
+  return _gps.getFix();
+}
+
+unsigned int gps_seq()
+{
+  return _gps.seq();
+}
+
+unsigned long gps_age()
+{
+  return _gps.age();
+}
+
+void gps_pps()
+{
+  _gps.pps();
+}
+
+void gps_track_get(gps_track_t *track)
+{
+  _gps.track_get(track);
+}
+
+// the command to leave the low power mode is sent right away
+void gps_power_auto(byte enable)
+{
+  _gps.power_auto(enable);
+  _gps.send_commands();
+}
+
+byte gps_power_mode()
+{
+  return _gps.power_mode();
+}
+
+byte gps_power_low_share()
+{
+  return _gps.power_low_share();
+}
+
+int gps_utc_bin_edge(unsigned long period, unsigned long *edge)
+{
+  return _gps.utc_bin_edge(period, edge);
+}
+
+unsigned long gps_utc_now()
+{
+  return _gps.utc_now();
+}
+
+unsigned long gps_utc_at(unsigned long ms)
+{
+  return _gps.utc_at(ms);
+}
+
+int gps_utc_next_edge(unsigned long period, unsigned long *ms)
+{
+  return _gps.utc_next_edge(period, ms);
+}
+
+int gps_get_next_line(char *str, int N, int timeout)
+{
+  return _gps.get_next_line(str, N, timeout);
+}
+
+// Get the receive statistics
+void gps_get_stats(gps_stats_t *stats)
+{
+  _gps.get_stats(stats);
+#if GPS_RX_RING_ENABLE
+  stats->dropped = GpsRxRing::dropped();
+  stats->overrun = GpsRxRing::overrun();
+#endif
+}
+
+// Report what was seen of the GPS so far
+// The MTK startup messages are caught by gps_update() at power up.
+void gps_diagnostics()
+{
+  char msg[30];
+  gps_stats_t stats;
+
+  gps_get_stats(&stats);
+
+  strcpy_P(msg, PSTR("GPS type MTK,"));
+  Serial.print(msg);
+  if (_gps.mtk_status() & GPS_MTK_INIT)
+    strcpy_P(msg, PSTR("yes"));
+  else
+    strcpy_P(msg, PSTR("no"));
+  Serial.println(msg);
+
+  strcpy_P(msg, PSTR("GPS system startup,"));
+  Serial.print(msg);
+  if (_gps.mtk_status() & GPS_MTK_STARTUP)
+    strcpy_P(msg, PSTR("yes"));
+  else
+    strcpy_P(msg, PSTR("no"));
+  Serial.println(msg);
+
+  strcpy_P(msg, PSTR("GPS commands pending,"));
+  Serial.print(msg);
+  Serial.println((int)_gps.command_pending());
+
+  strcpy_P(msg, PSTR("GPS commands failed,"));
+  Serial.print(msg);
+  Serial.println((int)_gps.command_failures());
+
+  strcpy_P(msg, PSTR("GPS rx bytes dropped,"));
+  Serial.print(msg);
+  Serial.println(stats.dropped);
+
+  strcpy_P(msg, PSTR("GPS rx overruns,"));
+  Serial.print(msg);
+  Serial.println(stats.overrun);
+
+  strcpy_P(msg, PSTR("GPS lines truncated,"));
+  Serial.print(msg);
+  Serial.println(stats.truncated);
+
+  strcpy_P(msg, PSTR("GPS checksum errors,"));
+  Serial.print(msg);
+  Serial.println(stats.chk_errors);
+}
+
+// Read a counter updated by the receive interrupt
+unsigned int gps_rx_stat(volatile unsigned int *cnt)
+{
+  unsigned int v;
+  uint8_t oldSREG = SREG;
+  cli();
+  v = *cnt;
+  SREG = oldSREG;
+  return v;
+}
+
+#if GPS_RX_RING_ENABLE
+// Read the serial port through the ring from now on
+// Drain the serial port from the Timer0 compare A interrupt. Timer0 runs
+// millis() so it overflows every 1024 us (2048 us at 8 MHz). The compare
+// match fires at the same rate and leaves the overflow vector alone.
+void GpsRxRing::attach(HardwareSerial *serial)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  _port = serial;
+  _head = 0;
+  _tail = 0;
+  _dropped = 0;  // clear receive statistics
+  _overrun = 0;
+  _burst_new = 0;
+  SREG = oldSREG;
+
+  OCR0A = 0x80;
+  TIMSK0 |= _BV(OCIE0A);
+}
+
+// Move all the bytes waiting in the core serial buffer to the ring.
+// A full core buffer means HardwareSerial may have dropped bytes since the
+// last call. Runs with interrupts disabled.
+void GpsRxRing::drain()
+{
+  int n = _port->available();
+  uint8_t head = _head;
+
+  if (n >= GPS_SERIAL_BUFFER_SZ-1)
+    _overrun++;
+
+  // the GPS is silent between epochs, note when it starts talking again
+  if (n > 0)
+  {
+    unsigned long now = millis();
+    if (now - _last > GPS_EPOCH_GAP)
+    {
+      _burst_time = now;
+      _burst_pos = head;
+      _burst_new = 1;
+    }
+    _last = now;
+  }
+
+  while (n-- > 0)
+  {
+    uint8_t c = _port->read();
+    if ((uint8_t)(head + 1) == _tail)
+    {
+      _dropped++;
+      continue;
+    }
+    _ring[head++] = c;
+  }
+  _head = head;
+}
+
+// Bytes lost because the ring was full
+unsigned int GpsRxRing::dropped()
+{
+  return gps_rx_stat(&_dropped);
+}
+
+// Times the core serial buffer was found full
+unsigned int GpsRxRing::overrun()
+{
+  return gps_rx_stat(&_overrun);
+}
+
+// The next byte read is the first one of a burst of sentences
+// returns 1 and sets t to the time it was received, 0 otherwise
+byte GpsRxRing::burst(unsigned long *t)
+{
+  if (!_burst_new || _tail != _burst_pos)
+    return 0;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  *t = _burst_time;
+  _burst_new = 0;
+  SREG = oldSREG;
+  return 1;
+}
+
+// Update routine on the ring
+// The first byte of a burst of sentences gives the time of the epoch.
+template <>
+void GpsReceiver<GpsRxRing>::update()
+{
+  unsigned long t;
+
+  while (_serial->available())
+  {
+    if (_serial->burst(&t))
+      epoch_start(t);
+    encode(_serial->read());
+  }
+
+  send_commands();
+}
+
+ISR(TIMER0_COMPA_vect)
+{
+  GpsRxRing::drain();
+}
+#endif
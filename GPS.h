@@ -72,12 +72,146 @@
 #define MTK_SET_NMEA_OUTPUT_ACK "$PMTK001,314,3*36"
 
 #define MTK_UPDATE_RATE_1HZ "$PMTK220,1000*1F"
-#define MTK_UPDATE_RATE_10HZ "$PMTK220,100*1F"
+#define MTK_UPDATE_RATE_5HZ "$PMTK220,200*2C"
+#define MTK_UPDATE_RATE_10HZ "$PMTK220,100*2F"
 #define MTK_UPDATE_RATE_ACK "$PMTK001,220,3*30"
 
+#define MTK_SET_BINARY "$PMTK253,1,0*37"
+
+// MTK binary protocol
+// 0x04 0x24, length (2), command (2), payload, checksum, 0x0D 0x0A
+#define MTK_BIN_PREAMBLE0 0x04
+#define MTK_BIN_PREAMBLE1 0x24
+#define MTK_BIN_OVERHEAD  7       // bytes of the frame outside command and payload
+#define MTK_BIN_ACK_CMD   0x0001  // ACK of a binary command
+#define MTK_BIN_ACK_EPO   0x0002  // ACK of an EPO packet
+#define MTK_BIN_SET_NMEA  0x00FD  // return to NMEA mode
+#define MTK_BIN_EPO       0x02D2  // EPO data packet (722)
+
+// SkyTraq (Venus) binary protocol, used by the Canmore modules
+// 0xA0 0xA1, length (2), message id and payload, checksum, 0x0D 0x0A
+// The receiver is set to binary output with message STQ_MSG_TYPE, payload
+// { 0x09, 0x02, 0x01 }. Set to 1 to parse its navigation data message.
+#ifndef GPS_SKYTRAQ_ENABLE
+#define GPS_SKYTRAQ_ENABLE 0
+#endif
+#define STQ_PREAMBLE0     0xA0
+#define STQ_PREAMBLE1     0xA1
+#define STQ_MSG_TYPE      0x09    // configure message type, NMEA or binary
+#define STQ_NAV_DATA      0xA8    // navigation data message
+#define STQ_NAV_DATA_SZ   59      // message id and payload of navigation data
+#define GPS_LEAP_SECONDS  18      // GPS time minus UTC, since 2017-01-01
+
+// u-blox UBX protocol
+// 0xB5 0x62, class, id, length (2), payload, Fletcher checksum (2)
+// gps_ubx_nmea_off() replaces the NMEA output by the NAV-DOP and NAV-PVT
+// messages. Set to 1 to parse them.
+#ifndef GPS_UBX_ENABLE
+#define GPS_UBX_ENABLE 0
+#endif
+#define UBX_SYNC0         0xB5
+#define UBX_SYNC1         0x62
+#define UBX_CLASS_NAV     0x01
+#define UBX_CLASS_CFG     0x06
+#define UBX_CLASS_NMEA    0xF0
+#define UBX_NAV_DOP       0x04    // dilution of precision
+#define UBX_NAV_PVT       0x07    // position, velocity and time
+#define UBX_NAV_DOP_SZ    18
+#define UBX_NAV_PVT_SZ    92
+#define UBX_CFG_MSG       0x01    // output rate of a message
+#define UBX_PVT_VALID_DATE 0x01   // NAV-PVT valid flags
+#define UBX_PVT_VALID_TIME 0x02
+#define UBX_PVT_FIX_OK    0x01    // NAV-PVT fix flags
+#define UBX_PVT_DIFF      0x02
+
 #define SBAS_ENABLE "$PMTK313,1*2E"
 #define DGPS_WAAS_ON "$PMTK301,2*2E"
 
+// NMEA sentences parsed, set to 0 those not needed to save flash
+#ifndef GPS_NMEA_RMC
+#define GPS_NMEA_RMC 1
+#endif
+#ifndef GPS_NMEA_GGA
+#define GPS_NMEA_GGA 1
+#endif
+#ifndef GPS_NMEA_GSA
+#define GPS_NMEA_GSA 0
+#endif
+#ifndef GPS_NMEA_GSV
+#define GPS_NMEA_GSV 0
+#endif
+#ifndef GPS_NMEA_VTG
+#define GPS_NMEA_VTG 0
+#endif
+#ifndef GPS_NMEA_ZDA
+#define GPS_NMEA_ZDA 0
+#endif
+
+// Epoch buffering
+// The parser writes to a second gps_t which is published when the RMC and
+// GGA sentences of the same UTC time were both received, so that the data
+// returned by gps_getData() always comes from one epoch. When set to 0 the
+// data is parsed in place, which saves the RAM of one gps_t. On by default
+// only on the ATmega1284P, the ATmega328P has no room for the second gps_t.
+#ifndef GPS_EPOCH_BUFFER
+#if defined(__AVR_ATmega1284P__)
+#define GPS_EPOCH_BUFFER 1
+#else
+#define GPS_EPOCH_BUFFER 0
+#endif
+#endif
+#define GPS_EPOCH_RMC 0x01
+#define GPS_EPOCH_GGA 0x02
+#if GPS_NMEA_GGA
+#define GPS_EPOCH_ALL (GPS_EPOCH_RMC | GPS_EPOCH_GGA)
+#else
+#define GPS_EPOCH_ALL GPS_EPOCH_RMC
+#endif
+
+// NMEA talkers
+#define GPS_TALKER_GP 0x01  // GPS
+#define GPS_TALKER_GN 0x02  // multi-GNSS solution
+#define GPS_TALKER_GL 0x04  // GLONASS
+#define GPS_TALKER_GA 0x08  // Galileo
+#define GPS_TALKER_GB 0x10  // BeiDou (GB or BD)
+
+// MTK command queue
+#define GPS_CMD_QUEUE_SZ  8     // maximum number of queued commands
+#define GPS_CMD_TIMEOUT   1000  // time to wait for ACK before retry (ms)
+#define GPS_CMD_RETRY     3     // number of times a command is sent
+
+// command queue status flags
+#define GPS_CMD_PENDING   0x01  // commands waiting for ACK
+#define GPS_CMD_ACKED     0x02  // a command was acknowledged
+#define GPS_CMD_FAILED    0x04  // a command failed or was never acknowledged
+
+// MTK module status flags
+#define GPS_MTK_INIT      0x01  // $PMTK011,MTKGPS received
+#define GPS_MTK_STARTUP   0x02  // $PMTK010,001 received
+
+// GPS receive ring
+// The bytes are moved from the 64 byte HardwareSerial buffer to a 256 byte
+// ring by the Timer0 compare A interrupt, so that long stalls of the main
+// loop (SD card writes, delays) do not lose GPS data. On by default only
+// on the ATmega1284P of the bGeigie3, the 2 KB of RAM of the ATmega328P
+// cannot spare the ring.
+#ifndef GPS_RX_RING_ENABLE
+#if defined(__AVR_ATmega1284P__)
+#define GPS_RX_RING_ENABLE 1
+#else
+#define GPS_RX_RING_ENABLE 0
+#endif
+#endif
+#define GPS_RX_RING_SZ        256   // fixed, the ring indices are bytes
+#define GPS_SERIAL_BUFFER_SZ  64    // SERIAL_BUFFER_SIZE of the core
+
+// UTC aligned bins
+#define GPS_EPOCH_GAP     50          // silence between two bursts of sentences (ms)
+#define GPS_UTC_HOLDOVER  60000       // time the UTC clock runs without GPS (ms)
+#define GPS_DAY_MS        86400000UL  // milliseconds in a day
+#define GPS_UTC_BIN_NONE  0xFFFFFFFF
+#define GPS_ISO8601_SZ    21          // YYYY-MM-DDThh:mm:ssZ and null character
+
 // GPS field size in characters
 #define LINE_SZ         100
 #define SYM_SZ          20
@@ -108,6 +242,89 @@ typedef struct
     char second[5];
 } date_time_t;
 
+// fix status flags
+#define GPS_FIX_VALID   0x01    // RMC status is 'A'
+#define GPS_FIX_REJECTED 0x02   // HDOP or satellites out of the filter bounds
+#define GPS_FIX_HELD    0x04    // jump from the last accepted fix, not confirmed yet
+
+// fix quality filter
+// A valid fix is rejected when its HDOP is too high or it uses too few
+// satellites, and held when the speed implied by the distance from the last
+// accepted fix is not plausible. A held fix is accepted once the next fix
+// confirms it, e.g. out of a tunnel. Rejected and held fixes keep their
+// data and are only flagged, the track and the stationarity detector skip
+// them. The filter keeps two positions, whatever the length of the track.
+#ifndef GPS_FILTER_ENABLE
+#define GPS_FILTER_ENABLE 1
+#endif
+#ifndef GPS_FILTER_SPEED
+#define GPS_FILTER_SPEED    8000      // highest implied speed (cm/s), raise it for flights
+#endif
+#define GPS_FILTER_HDOP     500       // highest HDOP x100
+#define GPS_FILTER_MIN_SAT  4         // fewest satellites used
+#define GPS_FILTER_DISTANCE 50        // position noise allowed on top of the speed (m)
+
+// packed date, year on 7 bits from 1980, month on 4 bits, day on 5 bits
+#define GPS_DATE(y, m, d)   ((((unsigned int)(y) - 1980) << 9) | ((unsigned int)(m) << 5) | (unsigned int)(d))
+#define GPS_DATE_YEAR(p)    (((p) >> 9) + 1980)
+#define GPS_DATE_MONTH(p)   (((p) >> 5) & 0x0F)
+#define GPS_DATE_DAY(p)     ((p) & 0x1F)
+
+// numeric fix data, filled by the parser along with the strings
+typedef struct
+{
+    int32_t lat;        // latitude in microdegrees, north positive
+    int32_t lon;        // longitude in microdegrees, east positive
+    int32_t altitude;   // altitude above sea level in decimeters
+    uint32_t time;      // UTC time of day in milliseconds
+    uint16_t date;      // UTC date, packed with GPS_DATE()
+    uint16_t hdop;      // horizontal dilution of precision x100
+    uint16_t pdop;      // position dilution of precision x100 (GSA)
+    uint16_t vdop;      // vertical dilution of precision x100 (GSA)
+    uint16_t speed;     // speed over ground in cm/s
+    uint16_t course;    // course over ground in degrees x100
+    uint8_t num_sat;    // number of satellites used
+    uint8_t sat_view;   // number of satellites in view (GSV)
+    uint8_t fix_type;   // 1 no fix, 2 2D, 3 3D (GSA)
+    uint8_t quality;    // GGA fix quality
+    uint8_t status;     // GPS_FIX_* flags
+} gps_fix_t;
+
+// motion aware power mode
+// After GPS_STILL_TIME without moving, the receiver is put in the low power
+// mode GPS_LOW_POWER_MODE. It is back to normal mode as soon as the speed or
+// the distance from where it stopped goes over the thresholds.
+#ifndef GPS_LOW_POWER_MODE
+#define GPS_LOW_POWER_MODE  MTK_ALWAYSLOCATE_MODE  // or MTK_PERIODIC_MODE
+#endif
+#define GPS_STILL_SPEED     100       // speed over ground when moving (cm/s)
+#define GPS_STILL_DISTANCE  25        // distance from the stop when moving (m)
+#define GPS_STILL_TIME      120000    // time still before low power (ms)
+#define GPS_POWER_FULL      0
+#define GPS_POWER_LOW       1
+
+// fix aggregation over a count bin
+#define GPS_TRACK_MAX_DT  2000    // longest time between fixes counted in distance (ms)
+
+typedef struct
+{
+    int32_t lat;        // mean latitude in microdegrees
+    int32_t lon;        // mean longitude in microdegrees
+    int32_t alt_min;    // lowest altitude in decimeters
+    int32_t alt_max;    // highest altitude in decimeters
+    uint32_t distance;  // distance travelled in centimeters
+    uint16_t n_fix;     // number of valid fixes aggregated
+} gps_track_t;
+
+// receive statistics, cleared by gps_init()
+typedef struct
+{
+    unsigned int dropped;     // bytes lost because the ring was full
+    unsigned int overrun;     // times the core serial buffer was found full
+    unsigned int truncated;   // lines longer than the line buffer
+    unsigned int chk_errors;  // sentences and binary frames with wrong checksum
+} gps_stats_t;
+
 // gps data structure
 typedef struct
 {
@@ -129,19 +346,466 @@ typedef struct
     char dev_name[DEV_NAME_SZ];
     char meas_type[MEAS_TYPE_SZ];
     date_time_t datetime;
+    gps_fix_t fix;
 } gps_t;
 
+// GPS parser
+// Holds the state of the streaming parser, the published data, the MTK
+// command queue, the UTC clock, the track aggregate and the power mode.
+// It never touches the serial port, GpsReceiver feeds it and sends the
+// queued commands, so it is compiled once whatever the port type.
+class GpsParser
+{
+  public:
+    void init(char *line);
+    int encode(char c);
+    int available();
+    unsigned long age();
+    gps_t *getData();
+    gps_fix_t *getFix();
+    unsigned int seq();
+    int command(const char *cmd);
+    byte command_status();
+    byte command_pending();
+    byte command_failures();
+    byte mtk_status();
+    int mtk_bin_ack(unsigned int *cmd, unsigned int *id);
+    void pps();
+    int utc_bin_edge(unsigned long period, unsigned long *edge);
+    unsigned long utc_now();
+    unsigned long utc_at(unsigned long ms);
+    int utc_next_edge(unsigned long period, unsigned long *ms);
+    void track_get(gps_track_t *track);
+    void power_auto(byte enable);
+    byte power_mode();
+    byte power_low_share();
+    void get_stats(gps_stats_t *stats);
+
+  protected:
+    void restart();                   // drop the sentence being received
+    void epoch_start(unsigned long t);  // first byte of a burst received at t
+    const char *command_due();        // head command if it must be sent now
+    unsigned long command_sent();     // head command sent, new baud rate or 0
+
+  private:
+    void parse_sentence(byte slot, char **token);  // call the sentence handler
+    void parse_line_rmc(char **token);  // parse RMC sentence (from NMEA protocol)
+    void parse_line_gga(char **token);  // parse GGA sentence (from NMEA protocol)
+    void parse_line_gsa(char **token);  // parse GSA sentence (from NMEA protocol)
+    void parse_line_gsv(char **token);  // parse GSV sentence (from NMEA protocol)
+    void parse_line_vtg(char **token);  // parse VTG sentence (from NMEA protocol)
+    void parse_line_zda(char **token);  // parse ZDA sentence (from NMEA protocol)
+    void parse_datetime();              // parse date and time into correct data struct
+    void parse_line_pmtk(char **token, byte n);  // parse MTK proprietary sentence
+    int encode_mtk_bin(byte c);         // receive MTK binary frames
+    void parse_mtk_bin(byte *buf, byte n);       // parse MTK binary message
+    int encode_skytraq(byte c);         // receive SkyTraq binary frames
+    void parse_skytraq(byte *buf, byte n);       // parse SkyTraq binary message
+    void parse_stq_nav(byte *buf);      // parse SkyTraq navigation data
+    int encode_ubx(byte c);             // receive UBX frames
+    void parse_ubx(byte *buf, byte n);  // parse UBX message
+    void parse_ubx_pvt(byte *buf);      // parse UBX NAV-PVT
+    void fix_strings(byte has_time);    // NMEA strings of a binary fix
+    void fix_done(byte has_time);       // date and time strings, UTC clock
+    void epoch_add(byte part, uint32_t time);  // publish when the epoch is complete
+    void publish();                     // filter, track, make the data visible to getData()
+    void command_done(byte flags);      // remove head of queue and report status
+    void utc_update(unsigned long time, unsigned int date);  // new UTC reference
+    void track_add(gps_fix_t *fix);     // add fix to the track aggregate
+    void motion_add(gps_fix_t *fix);    // stationarity detector
+    void power_set(byte mode);          // change and account power mode
+    byte filter(gps_fix_t *fix);        // fix quality filter, GPS_FIX_* flags
+
+    /* parsed data */
+    byte _updating;
+    gps_t _gps_buf[1 + GPS_EPOCH_BUFFER];  // GPS data structures
+    gps_t *_gps_data;             // data being parsed
+    gps_t *_gps_pub;              // data of the last complete epoch
+    unsigned int _gps_seq;        // number of epochs published
+    byte _epoch_parts;            // GPS_EPOCH_* sentences received for the epoch
+    uint32_t _epoch_time;         // UTC time of the epoch being received
+    char *_line;                  // buffer to receive new line from serial
+    byte _index;                  // current character index
+    unsigned long _rx_time;       // Timestamp of received time
+#if GPS_NMEA_GSV
+    uint8_t _gsv_in_view[5];      // satellites in view of each talker
+#endif
+
+    /* streaming parser state */
+    byte _state;                  // current state of the parser
+    byte _sentence;               // handler slot of the sentence being received
+    byte _chk;                    // running XOR checksum of the sentence
+    byte _chk_rx;                 // checksum received at the end of the sentence
+    byte _nfld;                   // index of the field being received
+    char *_tok[SYM_SZ];           // start of each field in the line buffer
+    byte _bin_len;                // binary, number of command and payload bytes
+    byte _ubx_class;              // UBX, class of the message being received
+    byte _ubx_id;                 // UBX, id of the message being received
+
+    /* MTK command queue */
+    const char *_cmd_queue[GPS_CMD_QUEUE_SZ];  // commands, in flash
+    byte _cmd_head;               // index of the command in flight
+    byte _cmd_count;              // number of commands in the queue
+    byte _cmd_tries;              // number of times the head command was sent
+    byte _cmd_send;               // 1 when the head command must be sent
+    byte _cmd_status;             // GPS_CMD_* flags
+    byte _cmd_failures;           // number of commands that failed
+    unsigned int _cmd_ack;        // command number expected in the ACK
+    unsigned long _cmd_time;      // time when the head command was sent
+    byte _mtk_status;             // GPS_MTK_* flags
+
+    /* last MTK binary ACK */
+    byte _bin_ack;                // 1 when a new ACK was received
+    byte _bin_ack_result;         // result flag of the ACK
+    unsigned int _bin_ack_cmd;    // ACK message, 0x0001 for commands, 0x0002 for EPO
+    unsigned int _bin_ack_id;     // acknowledged command or EPO packet sequence number
+
+    /* parse statistics */
+    unsigned int _rx_truncated;   // lines longer than the line buffer
+    unsigned int _rx_chk_errors;  // sentences with wrong checksum
+
+    /* timing of the sentences */
+    unsigned long _epoch_rx;      // start of reception of the current epoch
+    byte _epoch_rx_new;           // 1 until a RMC sentence used _epoch_rx
+    volatile unsigned long _pps_time;  // time of the last PPS pulse
+    volatile uint8_t _pps_new;    // 1 until a RMC sentence used _pps_time
+
+    /* UTC clock, extrapolated with millis() from the last RMC sentence */
+    byte _utc_valid;              // 1 when a reference was received
+    unsigned long _utc_ref_ms;    // UTC time of day at reference (ms)
+    unsigned int _utc_ref_date;   // UTC date at reference, packed
+    unsigned long _utc_ref_time;  // millis() at reference
+    unsigned long _utc_bin;       // index of the current bin in the day
+
+    /* track aggregation, positions are summed as deltas from the first fix */
+    uint16_t _trk_n;              // number of fixes in the bin
+    int32_t _trk_lat0, _trk_lon0; // first position of the bin
+    int32_t _trk_dlat, _trk_dlon; // sum of deltas from first position
+    int32_t _trk_alt_min, _trk_alt_max;  // altitude range
+    uint32_t _trk_dist;           // distance in centimeters x 1000
+    uint32_t _trk_last_time;      // UTC time of the previous valid fix
+    byte _trk_last_valid;         // 1 if the previous fix was valid
+
+    /* motion aware power mode */
+    byte _pwr_auto;               // 1 when the detector drives the power mode
+    byte _pwr_mode;               // GPS_POWER_FULL or GPS_POWER_LOW
+    unsigned long _pwr_ms[2];     // time spent in each mode (ms)
+    unsigned long _pwr_since;     // millis() at the last mode change
+    int32_t _still_lat, _still_lon;  // position where the receiver stopped
+    unsigned long _still_since;   // millis() when it stopped
+
+#if GPS_FILTER_ENABLE
+    /* fix quality filter */
+    byte _flt_state;              // GPS_FLT_* state of the filter
+    int32_t _flt_lat, _flt_lon;   // last accepted position
+    uint32_t _flt_time;           // UTC time of the last accepted fix
+    int32_t _hold_lat, _hold_lon; // held position
+    uint32_t _hold_time;          // UTC time of the held fix
+#endif
+};
+
+// GPS receiver on a serial port of type SerialT
+// SerialT is HardwareSerial, GpsRxRing, or any class with available(),
+// read(), write(uint8_t), flush() and begin(baud), no base class is
+// needed. With HardwareSerial the calls still go through the Stream
+// vtable. With GpsRxRing the parser reads the ring inline, the writes and
+// the drain from the interrupt go through the vtable of the HardwareSerial
+// given to attach(). A plain class, such as the stub of the host tests,
+// is called directly.
+template <class SerialT>
+class GpsReceiver : public GpsParser
+{
+  public:
+    void begin(SerialT *serial, char *line);
+    void update();
+    void flush();
+    int command(const char *cmd);
+    void send_commands();
+    void send_command(char *cmd);
+    void send_bytes(const byte *buf, int n);
+    void send_message(const uint8_t *msg, uint16_t len);
+    void ubx_send(byte cls, byte id, const byte *payload, uint16_t len);
+    void ubx_nmea_off();
+    int get_next_line(char *str, int N, int timeout);
+
+  private:
+    SerialT *_serial;             // The serial port used by GPS
+    unsigned long _rx_last;       // time of the last received byte
+};
+
+// Constructor
+// we need to provide the line buffer for RAM efficiency
+template <class SerialT>
+void GpsReceiver<SerialT>::begin(SerialT *serial, char *line)
+{
+  _serial = serial; // serial connection, supposed to be initialized
+  _rx_last = millis();
+  init(line);
+}
+
+// Update routine
+template <class SerialT>
+void GpsReceiver<SerialT>::update()
+{
+  if (_serial->available())
+  {
+    unsigned long now = millis();
+    if (now - _rx_last > GPS_EPOCH_GAP)
+      epoch_start(now);
+    _rx_last = now;
+  }
+  while (_serial->available())
+    encode(_serial->read());
+
+  send_commands();
+}
+
+// Discard everything received from the GPS so far
+template <class SerialT>
+void GpsReceiver<SerialT>::flush()
+{
+  while (_serial->available())
+    _serial->read();
+  restart();
+}
+
+// Queue a PMTK command stored in flash, e.g. command(PSTR(MTK_UPDATE_RATE_1HZ))
+// The command is sent right away if nothing is in flight, the next ones
+// from update() once the previous ones are acknowledged.
+// returns 0 if the queue is full
+template <class SerialT>
+int GpsReceiver<SerialT>::command(const char *cmd)
+{
+  if (!GpsParser::command(cmd))
+    return 0;
+  send_commands();
+  return 1;
+}
+
+// Send the commands of the queue that are due, first sending or retry
+template <class SerialT>
+void GpsReceiver<SerialT>::send_commands()
+{
+  const char *cmd;
+  unsigned long baud;
+  char c;
+
+  while ((cmd = command_due()) != NULL)
+  {
+    while ((c = pgm_read_byte(cmd++)) != '\0')
+      _serial->write(c);
+    _serial->write('\r');
+    _serial->write('\n');
+
+    // baud rate change is not acknowledged, follow the GPS to the new rate
+    baud = command_sent();
+    if (baud != 0)
+    {
+      _serial->flush();
+      _serial->begin(baud);
+    }
+  }
+}
+
+// A simple wrapper to send commands to the GPS through serial
+template <class SerialT>
+void GpsReceiver<SerialT>::send_command(char *cmd)
+{
+  while (*cmd != '\0')
+    _serial->write(*cmd++);
+  _serial->write('\r');
+  _serial->write('\n');
+}
+
+// Send raw bytes to the GPS, e.g. a binary protocol frame
+template <class SerialT>
+void GpsReceiver<SerialT>::send_bytes(const byte *buf, int n)
+{
+  while (n-- > 0)
+    _serial->write(*buf++);
+}
+
+// Send a SkyTraq binary message, len bytes of message id and payload
+template <class SerialT>
+void GpsReceiver<SerialT>::send_message(const uint8_t *msg, uint16_t len)
+{
+  uint8_t chk = 0;
+
+  _serial->write(STQ_PREAMBLE0);
+  _serial->write(STQ_PREAMBLE1);
+  _serial->write(len >> 8);
+  _serial->write(len & 0xFF);
+  while (len-- > 0)
+  {
+    chk ^= *msg;
+    _serial->write(*msg++);
+  }
+  _serial->write(chk);
+  _serial->write('\r');
+  _serial->write('\n');
+}
+
+// Send a UBX message, len bytes of payload
+template <class SerialT>
+void GpsReceiver<SerialT>::ubx_send(byte cls, byte id, const byte *payload, uint16_t len)
+{
+  byte hdr[4] = { cls, id, (byte)(len & 0xFF), (byte)(len >> 8) };
+  byte ck_a = 0, ck_b = 0;
+  byte i;
+
+  _serial->write(UBX_SYNC0);
+  _serial->write(UBX_SYNC1);
+  for (i = 0 ; i < 4 ; i++)
+  {
+    ck_a += hdr[i];
+    ck_b += ck_a;
+    _serial->write(hdr[i]);
+  }
+  while (len-- > 0)
+  {
+    ck_a += *payload;
+    ck_b += ck_a;
+    _serial->write(*payload++);
+  }
+  _serial->write(ck_a);
+  _serial->write(ck_b);
+}
+
+// Switch the standard NMEA sentences of a u-blox receiver off and output
+// NAV-DOP and NAV-PVT instead, once per fix, on the port of the receiver
+// The setting is not saved, call again after the receiver is powered up.
+template <class SerialT>
+void GpsReceiver<SerialT>::ubx_nmea_off()
+{
+  byte msg[3];
+
+  // GGA, GLL, GSA, GSV, RMC, VTG
+  msg[0] = UBX_CLASS_NMEA;
+  msg[2] = 0;
+  for (msg[1] = 0 ; msg[1] <= 5 ; msg[1]++)
+    ubx_send(UBX_CLASS_CFG, UBX_CFG_MSG, msg, 3);
+
+  msg[0] = UBX_CLASS_NAV;
+  msg[2] = 1;
+  msg[1] = UBX_NAV_DOP;
+  ubx_send(UBX_CLASS_CFG, UBX_CFG_MSG, msg, 3);
+  msg[1] = UBX_NAV_PVT;
+  ubx_send(UBX_CLASS_CFG, UBX_CFG_MSG, msg, 3);
+}
+
+// Gets next gps line, or up to N characters
+// This routine is blocking
+// returns 1 for success, 0 for failure (timeout or N reached)
+template <class SerialT>
+int GpsReceiver<SerialT>::get_next_line(char *str, int N, int timeout)
+{
+  int i = 0;
+  unsigned long now = millis();
+  while (1)
+  {
+    while (_serial->available())
+    {
+      str[i] = _serial->read();
+      if (i == N || str[i] == '\n')
+        goto out;
+      i++;
+    }
+    if (millis() - now > timeout)
+      break;
+  }
+out:
+  // terminate string
+  str[i+1] = 0;
+  // return error if did not terminate correctly
+  if (i == N || millis() - now >= timeout)
+    return 0;
+  else
+    return 1;
+}
+
+#if GPS_RX_RING_ENABLE
+// GPS serial port read through the receive ring
+// There is one ring, filled by the Timer0 compare A interrupt from the port
+// given to attach(), so all the objects of this class share it.
+class GpsRxRing
+{
+  public:
+    static void attach(HardwareSerial *serial);
+    static void drain();
+    static unsigned int dropped();
+    static unsigned int overrun();
+    byte burst(unsigned long *t);
+
+    int available() { return (uint8_t)(_head - _tail); }
+    int read()
+    {
+      if (_head == _tail)
+        return -1;
+      return _ring[_tail++];
+    }
+    size_t write(uint8_t c) { return _port->write(c); }
+    void flush() { _port->flush(); }
+    void begin(unsigned long baud) { _port->begin(baud); }
+
+  private:
+    static HardwareSerial *_port;     // The serial port used by GPS
+    static volatile uint8_t _ring[GPS_RX_RING_SZ];  // 256 bytes, indices wrap on their own
+    static volatile uint8_t _head;    // next byte written by the interrupt
+    static volatile uint8_t _tail;    // next byte read by the parser
+    static volatile unsigned int _dropped;   // bytes lost because the ring was full
+    static volatile unsigned int _overrun;   // times the core serial buffer was found full
+    static volatile unsigned long _last;     // time of the last received byte
+    static volatile unsigned long _burst_time;  // time of the first byte after a silence
+    static volatile uint8_t _burst_pos;      // position of that byte in the ring
+    static volatile uint8_t _burst_new;      // 1 until the parser reaches that byte
+};
+
+// the interrupt gives the time of the bursts, see GPS.cpp
+template <>
+void GpsReceiver<GpsRxRing>::update();
+#endif
+
 // 'public' methods
+// They work on one receiver in GPS.cpp, on the port given to gps_init()
 void gps_init(HardwareSerial *serial, char *line);
 void gps_send_command(char *cmd);
+int gps_command(const char *cmd);
+byte gps_command_status();
+byte gps_command_pending();
+byte gps_mtk_status();
+void gps_send_bytes(const byte *buf, int n);
+int gps_mtk_bin_ack(unsigned int *cmd, unsigned int *id);
+void gps_send_message(const uint8_t *msg, uint16_t len);
+void gps_ubx_send(byte cls, byte id, const byte *payload, uint16_t len);
+void gps_ubx_nmea_off();
 void gps_update();
+void gps_flush();
+int gps_encode(char c);
 int gps_available();
 gps_t *gps_getData();
+gps_fix_t *gps_getFix();
+unsigned int gps_seq();
+long gps_parse_fixed(char *s, byte dec);
 char gps_checksum(char *s, int N);
 int gps_checksum_match(char *str, int L, char *chk);
 int gps_verify_NMEA_sentence(char *sentence, int L);
 unsigned long gps_age();
+void gps_pps();
+void gps_track_get(gps_track_t *track);
+void gps_power_auto(byte enable);
+byte gps_power_mode();
+byte gps_power_low_share();
+void gps_format_coord(char *buf, long v, byte deg_digits);
+int gps_utc_bin_edge(unsigned long period, unsigned long *edge);
+unsigned long gps_utc_now();
+unsigned long gps_utc_at(unsigned long ms);
+int gps_utc_next_edge(unsigned long period, unsigned long *ms);
+unsigned long gps_utc_seconds(unsigned int date, unsigned long ms);
+unsigned long gps_days_from_civil(unsigned int y, byte m, byte d);
+unsigned int gps_date_from_days(unsigned long days);
+byte gps_iso8601(char *buf, unsigned long t);
 int gps_get_next_line(char *str, int N, int timeout);
+void gps_get_stats(gps_stats_t *stats);
 void gps_diagnostics();
 
 #endif /* GPS_H */
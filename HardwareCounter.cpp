@@ -29,69 +29,218 @@
 */
 
 #include "HardwareCounter.h"
+#include "counter_snapshot.h"
 #include <limits.h>
 
 // need to have the global variable to count
-// overflows
-unsigned int g_ovf_n;
+// overflows, it holds the high part of the 32 bit count
+volatile unsigned long g_ovf_ext;
+#if defined(TCNT3)
+volatile unsigned long g_ovf3_ext;
+#endif
 
-// Constructor
-HardwareCounter::HardwareCounter(int timer_pin, long delay)
+// the counters which bins are closed by the Timer0 compare B interrupt
+static CounterBins *g_scheduled[COUNTER_MAX];
+
+// Timer1 as counter ( refer atmega168.pdf chapter 16-bit counter1)
+void Timer1::setup()
+{
+  TCCR1A=0;     // reset timer/counter1 control register A
+  TCCR1B=0;     // reset timer/counter1 control register B
+
+  // set timer/counter1 hardware as counter , counts events on pin T1 ( arduino pin 5 on 168, pin 47 on Mega )
+  // normal mode, wgm10 .. wgm13 = 0
+  sbi (TCCR1B ,CS10);  // External clock source on T1 pin. Clock on rising edge.
+  sbi (TCCR1B ,CS11);
+  sbi (TCCR1B ,CS12);
+
+  // set overflow interrupt
+  TIMSK1 |= _BV(TOIE1);
+}
+
+// Zero the count, with interrupts off
+void Timer1::clear()
+{
+  TCNT1=0;      // counter value = 0
+  TIFR1 = _BV(TOV1);  // clear pending overflow
+
+  // reset number of overflow
+  g_ovf_ext = 0;
+}
+
+unsigned long Timer1::snapshot()
+{
+  return counter_snapshot16(&TCNT1, &TIFR1, TOV1, &g_ovf_ext);
+}
+
+#if defined(TCNT3)
+// Timer3 as counter, the same on pin T3
+void Timer3::setup()
+{
+  TCCR3A=0;     // the core sets Timer3 up for PWM
+  TCCR3B = _BV(CS30) | _BV(CS31) | _BV(CS32);  // External clock source on T3 pin. Clock on rising edge.
+  TIMSK3 |= _BV(TOIE3);
+}
+
+void Timer3::clear()
+{
+  TCNT3=0;
+  TIFR3 = _BV(TOV3);
+  g_ovf3_ext = 0;
+}
+
+unsigned long Timer3::snapshot()
+{
+  return counter_snapshot16(&TCNT3, &TIFR3, TOV3, &g_ovf3_ext);
+}
+#endif
+
+// Constructor, snap reads the running total of the timer
+CounterBins::CounterBins(int timer_pin, long delay, unsigned long (*snap)())
 {
   // register delay
   _delay = delay;
   // register timer pin
   _pin = timer_pin;
+  _snap = snap;
 }
 
-// call this to start the counter
-void HardwareCounter::start()
+// Change the length of the bins, before start()
+void CounterBins::set_delay(long delay)
 {
-  // set pin as digital input
-  pinMode(_pin, INPUT);
+  // the interrupt may be closing bins
+  uint8_t oldSREG = SREG;
+  cli();
+  _delay = delay;
+  SREG = oldSREG;
+}
 
-  // hardware counter setup ( refer atmega168.pdf chapter 16-bit counter1)
-  TCCRnA=0;     // reset timer/countern control register A
-  TCCRnB=0;     // reset timer/countern control register A
+// The bins start over with the count, called by start() with interrupts off
+void CounterBins::restart()
+{
+  // set start time
+  _start_time = millis();
 
-  // set timer/counter1 hardware as counter , counts events on pin Tn ( arduino pin 5 on 168, pin 47 on Mega )
-  // normal mode, wgm10 .. wgm13 = 0
-  sbi (TCCRnB ,CS10);  // External clock source on Tn pin. Clock on rising edge.
-  sbi (TCCRnB ,CS11);
-  sbi (TCCRnB ,CS12);
-  // start counting now
-  TCCRnB = TCCRnB | 7;  //  Counter Clock source = pin Tn , start counting now
+  // the bins closed by the interrupt start over too
+  _last = 0;
+  _edge = _start_time + _delay;
+  _q_head = 0;
+  _q_count = 0;
+}
 
-  // set overflow interrupt
-  TIMSKn |= _BV(TOIEn);
+// call this to read the current count, since start()
+unsigned long CounterBins::count()
+{
+  return snapshot();
+}
 
-  // set start time
+// Running total of counts since start(), the counter is not stopped
+unsigned long CounterBins::snapshot()
+{
+  return _snap();
+}
+
+// Counts of the bin that just ended, the next bin starts at the same snapshot
+// The total wraps around at 2^32 along with the difference.
+unsigned long CounterBins::next_bin()
+{
+  unsigned long now = snapshot();
+  unsigned long cpb = now - _last;
+
+  _last = now;
   _start_time = millis();
 
-  // The counter needs to be reset after
-  // the counter is setup (This is important)!
-  TCNTn=0;      // counter value = 0
+  return cpb;
+}
 
-  // reset number of overflow
-  g_ovf_n = 0;
+// Close the bins from the Timer0 compare B interrupt, after start()
+// Timer0 runs the millis() tick and its compare A interrupt reads the GPS,
+// compare B is free. OCR0B is set away from OCR0A so that the two
+// interrupts do not come back to back.
+void CounterBins::schedule()
+{
+  byte i;
 
-  // set count to zero (optional)
-  _count = 0;
+  uint8_t oldSREG = SREG;
+  cli();
+  for (i = 0 ; i < COUNTER_MAX ; i++)
+  {
+    if (g_scheduled[i] == this)
+      break;
+    if (g_scheduled[i] == NULL)
+    {
+      g_scheduled[i] = this;
+      break;
+    }
+  }
+  OCR0B = 0x20;
+  TIMSK0 |= _BV(OCIE0B);
+  SREG = oldSREG;
 }
 
-// call this to read the current count and save it
-unsigned long HardwareCounter::count()
+// Move the end of the current bin to the millis() time edge, e.g. a UTC
+// time edge from the GPS. The bin is shortened or stretched once, the next
+// ones are of the normal length.
+void CounterBins::align(unsigned long edge)
 {
+  uint8_t oldSREG = SREG;
+  cli();
+  // the edge that just closed the bin, seen a little late, is not used
+  // again for a bin of a few ms
+  if ((long)(edge - _start_time) < _delay / 2)
+    edge += _delay;
+  _edge = edge;
+  SREG = oldSREG;
+}
 
-  TCCRnB = TCCRnB & ~7;   // Gate Off  / Counter Tn stopped
-  _count = TCNTn;         // Set the count in object variable
-  TCCRnB = TCCRnB | 7;    // restart counting
-  return 0x10000ul*g_ovf_n + _count;
+// Read the oldest bin closed by the interrupt
+// returns 1 and fills bin, 0 when the queue is empty
+byte CounterBins::get_bin(bin_t *bin)
+{
+  byte ret = 0;
+  uint8_t oldSREG = SREG;
+  cli();
+  if (_q_count > 0)
+  {
+    *bin = _queue[_q_head];
+    _q_head = (_q_head + 1) % BIN_QUEUE_SZ;
+    _q_count--;
+    ret = 1;
+  }
+  SREG = oldSREG;
+  return ret;
+}
+
+// Close the bin when its end is reached, called from the interrupt
+void CounterBins::tick(unsigned long now)
+{
+  bin_t *bin;
+  unsigned long snap;
+
+  if ((long)(now - _edge) < 0)
+    return;
+  _edge += _delay;
+  // an edge long past, e.g. from align(), does not make a burst of bins
+  if ((long)(now - _edge) >= 0)
+    _edge = now + _delay;
+
+  // the queue is full, the bin goes on until the next edge
+  if (_q_count >= BIN_QUEUE_SZ)
+    return;
+
+  snap = snapshot();
+  bin = &_queue[(_q_head + _q_count) % BIN_QUEUE_SZ];
+  bin->count = snap - _last;
+  bin->start = _start_time;
+  bin->end = now;
+  _q_count++;
 
+  _last = snap;
+  _start_time = now;
 }
 
 // This indicates when the count over the determined period is over
-int HardwareCounter::available()
+int CounterBins::available()
 {
   // get current time
   unsigned long now = millis();
@@ -103,9 +252,26 @@ int HardwareCounter::available()
 }
 
 // This takes care of the counter overflow problem
-ISR(TIMERn_OVF_vect)
+ISR(TIMER1_OVF_vect)
 {
   // increment number of overflows
-  g_ovf_n++;
+  g_ovf_ext += 0x10000;
 }
 
+#if defined(TCNT3)
+// Timer3 overflows, counting pulses or as the time base of the PulseTimer
+ISR(TIMER3_OVF_vect)
+{
+  g_ovf3_ext += 0x10000;
+}
+#endif
+
+// Runs once per Timer0 overflow, every 1 ms at 16 MHz and 2 ms at 8 MHz
+ISR(TIMER0_COMPB_vect)
+{
+  unsigned long now = millis();
+  byte i;
+
+  for (i = 0 ; i < COUNTER_MAX && g_scheduled[i] != NULL ; i++)
+    g_scheduled[i]->tick(now);
+}
@@ -43,32 +43,131 @@
 #define sbi(sfr, bit) (_SFR_BYTE(sfr) |= _BV(bit))
 #endif
 
-#define TCCRnA TCCR1A
-#define TCCRnB TCCR1B
-#define TCNTn  TCNT1
-#define TIFRn  TIFR1
-#define TOVn   TOV1
-#define TIMSKn TIMSK1
-#define TOIEn  TOIE1
-#define TIMERn_OVF_vect TIMER1_OVF_vect
-
-// Defining the Class for the counter
-class HardwareCounter
+// bins closed by the interrupt and not yet read by get_bin()
+#define BIN_QUEUE_SZ 4
+
+// counters which bins the interrupt closes, one per timer
+#define COUNTER_MAX 2
+
+// A bin closed by the interrupt, times are millis()
+typedef struct
+{
+  unsigned long count;    // counts in the bin
+  unsigned long start;    // time of the start of the bin
+  unsigned long end;      // time of the end of the bin
+} bin_t;
+
+// The timers that count pulses on their external clock input
+// setup() sets the timer as counter on the rising edge of its Tn pin with
+// the overflow interrupt, clear() zeroes the count with interrupts off, and
+// snapshot() reads the count extended to 32 bits by the overflow interrupt.
+struct Timer1
+{
+  static void setup();
+  static void clear();
+  static unsigned long snapshot();
+};
+
+#if defined(TCNT3)
+// T3 is PD0 on the 1284P, along with RXD0
+struct Timer3
+{
+  static void setup();
+  static void clear();
+  static unsigned long snapshot();
+};
+#endif
+
+// The bins of a counter, whatever its timer
+// Three ways to count bins: count() then start() zeroes the timer between
+// bins, pulses between the two calls are lost. next_bin() leaves the timer running from start() on, and
+// returns the difference of two snapshots of the running total, so that
+// no pulse is lost between bins. After schedule(), the bins are closed by
+// the Timer0 compare B interrupt, which runs with the millis() tick: at the
+// first run past the end of each bin it takes the snapshot and queues it
+// with the time, the next end is counted from the planned one so that the
+// bins do not drift. get_bin() reads the queue. The bins then have the
+// right length however late the loop reads them. When the queue is full
+// the bin goes on until there is room again, its start and end tell how
+// long it was. Each counter has its own bins and queue.
+class CounterBins
 {
   // public
   public:
-    HardwareCounter(int timer_pin, long delay);
-    void start();
+    CounterBins(int timer_pin, long delay, unsigned long (*snap)());
+    void set_delay(long delay);
     int available();
     unsigned long count();
+    unsigned long snapshot();
+    unsigned long next_bin();
+    void schedule();
+    void align(unsigned long edge);
+    byte get_bin(bin_t *bin);
+    void tick(unsigned long now);
+
+  protected:
+    void restart();
+    unsigned int _pin;
 
   // privatee
   private:
+    unsigned long (*_snap)();
     long _start_time;
     long _delay;
-    unsigned int _count;
-    unsigned int _pin;
+    unsigned long _last;    // snapshot at the start of the bin
+
+    // bins closed by the interrupt
+    unsigned long _edge;    // millis() at the end of the bin
+    bin_t _queue[BIN_QUEUE_SZ];
+    volatile byte _q_head;
+    volatile byte _q_count;
+
+};
+
+// Defining the Class for the counter, on the timer given by the traits
+// above, e.g. TimerCounter<Timer3>. Two counters on two timers count
+// at the same time, with their own bins. To pair their bins, set both up
+// then clear both with interrupts off: the bins start on the same millis()
+// and are closed by the same interrupt.
+template <class TIMER>
+class TimerCounter : public CounterBins
+{
+  public:
+    TimerCounter(int timer_pin, long delay)
+      : CounterBins(timer_pin, delay, TIMER::snapshot) {}
+
+    // call this to start the counter
+    void start()
+    {
+      setup();
+
+      // The counter needs to be reset after
+      // the counter is setup (This is important)!
+      // The overflow interrupt must not see the old count.
+      uint8_t oldSREG = SREG;
+      cli();
+      clear();
+      SREG = oldSREG;
+    }
 
+    // set the pin and the timer up, the count is not zeroed
+    void setup()
+    {
+      // set pin as digital input
+      pinMode(_pin, INPUT);
+
+      TIMER::setup();
+    }
+
+    // zero the count and start the bins, with interrupts off
+    void clear()
+    {
+      TIMER::clear();
+      restart();
+    }
 };
 
+// The counter of the Geiger tube, on Timer1
+typedef TimerCounter<Timer1> HardwareCounter;
+
 #endif /* COUNTER_H */
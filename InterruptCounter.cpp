@@ -29,13 +29,14 @@
 */
 
 #include "InterruptCounter.h"
+#include "counter_snapshot.h"
 #include <limits.h>
 
 // Declare variables here
 int _interrupt_pin;
 unsigned long _start_time;
 unsigned long _delay;
-unsigned long _count;
+volatile unsigned long _count;
 
 // private methods here
 void interrupt_routine();
@@ -54,8 +55,11 @@ void interruptCounterReset()
 {
   // set start time
   _start_time = millis();
-  // set count to zero (optional)
+  // set count to zero, the interrupt must not run in between
+  uint8_t oldSREG = SREG;
+  cli();
   _count = 0;
+  SREG = oldSREG;
 }
 
 // This indicates when the count over the determined period is over
@@ -73,7 +77,7 @@ int interruptCounterAvailable()
 // return current number of counts
 unsigned long interruptCounterCount()
 {
-  return _count;
+  return counter_snapshot32(&_count);
 }
 
 // The interrupt routine, simply increment count on every event
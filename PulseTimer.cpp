@@ -0,0 +1,192 @@
+/*
+   Timestamps of the counter pulses and histogram of their intervals
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "PulseTimer.h"
+#include "HardwareCounter.h"
+
+// Timer3 is the time base, boards without it have no pulse timer
+#if defined(TCNT3)
+
+// the pulse timer the external interrupt writes to
+static PulseTimer *g_pulse_timer;
+
+static void pulse_timer_isr()
+{
+  if (g_pulse_timer)
+    g_pulse_timer->push();
+}
+
+// Constructor, interrupt is the external interrupt of the counter pin as
+// given to attachInterrupt()
+PulseTimer::PulseTimer(int interrupt)
+{
+  _int = interrupt;
+  _head = 0;
+  _tail = 0;
+  _fallback = 1;
+}
+
+// Start Timer3 and the timestamps, the histogram is cleared
+void PulseTimer::start()
+{
+  detachInterrupt(_int);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  // normal mode, the core sets Timer3 up for PWM
+  TCCR3A = 0;
+  TCCR3B = _BV(CS31);   // clock / 8, 1 us at 8 MHz
+  TIMSK3 |= _BV(TOIE3);
+  Timer3::clear();      // its overflow interrupt is with the counters
+  g_pulse_timer = this;
+  _fallback = 1;        // clear() turns the interrupt on
+  SREG = oldSREG;
+
+  clear();
+}
+
+// Start a new histogram, and timestamp the pulses again if the interrupt
+// went off
+void PulseTimer::clear()
+{
+  byte b;
+
+  for (b = 0 ; b < PT_HIST_SZ ; b++)
+    _hist[b] = 0;
+  _intervals = 0;
+  _start_time = millis();
+
+  // the interrupt is off, it is the only writer of the head
+  if (_fallback)
+  {
+    _tail = _head;
+    // an edge before the interrupt was on may still be pending, the
+    // first interval is not counted
+    _skip = 2;
+    _fallback = 0;
+    attachInterrupt(_int, pulse_timer_isr, RISING);
+  }
+}
+
+// Count the intervals between the timestamps in the ring, from the loop
+void PulseTimer::process()
+{
+  unsigned long t, dt;
+  byte b;
+
+  while (_tail != _head)
+  {
+    t = _ring[_tail];
+    _tail = (_tail + 1) & (PT_RING_SZ - 1);
+
+    if (_skip > 0)
+    {
+      _skip--;
+    }
+    else
+    {
+      // Timer3 ticks to us, intervals that long are in the last bin anyway
+      dt = t - _last;
+      if (dt < 0x10000000UL)
+        dt = dt * 8 / (F_CPU / 1000000UL);
+      b = bin_of(dt);
+      if (_hist[b] < 0xFFFF)
+        _hist[b]++;
+      _intervals++;
+    }
+    _last = t;
+  }
+}
+
+// Number of intervals in bin b
+unsigned int PulseTimer::hist(byte b)
+{
+  return _hist[b];
+}
+
+// Number of intervals since clear(), bins saturated or not
+unsigned long PulseTimer::intervals()
+{
+  return _intervals;
+}
+
+// Time since clear() in ms
+unsigned long PulseTimer::elapsed()
+{
+  return millis() - _start_time;
+}
+
+// 1 when the ring was full since clear() and pulses were not timestamped
+byte PulseTimer::incomplete()
+{
+  return _fallback;
+}
+
+// Shortest interval of bin b in us
+unsigned long PulseTimer::bin_low(byte b)
+{
+  if (b < PT_HIST_LIN)
+    return b * (unsigned long)PT_HIST_W;
+  return ((unsigned long)PT_HIST_LIN * PT_HIST_W) << (b - PT_HIST_LIN);
+}
+
+// Bin of an interval in us
+byte PulseTimer::bin_of(unsigned long us)
+{
+  byte b;
+
+  if (us < PT_HIST_LIN * PT_HIST_W)
+    return us / PT_HIST_W;
+
+  // octaves from 1024 us, the last bin takes all the longer intervals
+  us /= PT_HIST_LIN * PT_HIST_W;
+  for (b = PT_HIST_LIN ; us > 1 && b < PT_HIST_SZ - 1 ; b++)
+    us >>= 1;
+  return b;
+}
+
+// Timestamp a pulse, called from the external interrupt
+void PulseTimer::push()
+{
+  unsigned long t = Timer3::snapshot();
+  byte next = (_head + 1) & (PT_RING_SZ - 1);
+
+  // the loop is behind, the pulses are only counted until clear()
+  if (next == _tail)
+  {
+    detachInterrupt(_int);
+    _fallback = 1;
+    return;
+  }
+
+  _ring[_head] = t;
+  _head = next;
+}
+
+#endif /* TCNT3 */
@@ -0,0 +1,95 @@
+/*
+   Timestamps of the counter pulses and histogram of their intervals
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PULSETIMER_H
+#define PULSETIMER_H
+
+// Link to arduino library
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#define PT_RING_SZ 128     // timestamps not yet processed, a power of 2
+#define PT_HIST_W   64     // width of the linear bins in us, over the timestamp jitter
+#define PT_HIST_LIN 16     // bins of 64 us from 0 to 1024 us
+#define PT_HIST_SZ  32     // then one bin per octave, the last one is open
+
+// Histogram of the intervals between the pulses of the tube
+// The external interrupt of the counter pin timestamps each pulse with
+// Timer3, free running at clock / 8, and puts the time in a ring. The
+// interrupt is the only writer of the head of the ring and process(), from
+// the loop, the only writer of the tail, so that neither needs to stop
+// interrupts. process() turns the timestamps into intervals, counted in
+// the histogram: 64 us bins up to 1024 us where double pulses and the dead
+// time show, then one bin per octave up to 33.5 s for the exponential of
+// the background. The bins of the histogram saturate at 65535.
+// Timer3 is read by the interrupt, not captured by the hardware, so a
+// timestamp is late by the interrupt that runs when the pulse comes. The
+// external interrupt comes before the timers, it only waits for the one
+// that runs: at 8 MHz about 60 us for the Timer0 compare B tick that
+// closes the bins of two counters, 30 us for the compare A drain of the
+// few GPS bytes of a tick, less for the overflows. An interval is then off
+// by up to about 60 us, less than a linear bin. The drain of a full 64
+// byte serial buffer, after interrupts were off for a while, takes up to
+// about 700 us and may move a short interval a few bins, rarely.
+// When the loop cannot keep up and the ring is full, the interrupt turns
+// itself off and the histogram is incomplete(). The pulses are still
+// counted by the hardware counter on Timer1. clear() starts a new histogram
+// and timestamps again. Timer3 cannot count a second tube at the same time.
+class PulseTimer
+{
+  public:
+    PulseTimer(int interrupt);
+    void start();
+    void process();
+    void clear();
+    unsigned int hist(byte b);
+    unsigned long intervals();
+    unsigned long elapsed();
+    byte incomplete();
+    static unsigned long bin_low(byte b);
+    static byte bin_of(unsigned long us);
+    void push();
+
+  private:
+    int _int;
+    volatile unsigned long _ring[PT_RING_SZ];
+    volatile byte _head;            // next timestamp, written by the interrupt
+    volatile byte _tail;            // oldest timestamp, written by process()
+    volatile byte _fallback;        // the ring was full, the interrupt is off
+    byte _skip;                     // timestamps before the first interval
+    unsigned long _last;            // timestamp of the last pulse processed
+    unsigned int _hist[PT_HIST_SZ];
+    unsigned long _intervals;       // intervals in the histogram
+    unsigned long _start_time;      // millis() at clear()
+};
+
+#endif /* PULSETIMER_H */
@@ -0,0 +1,114 @@
+/*
+   Alarm on a significant increase of the count rate
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "RateAlarm.h"
+
+// Constructor
+RateAlarm::RateAlarm()
+{
+  reset();
+}
+
+// Forget the background, e.g. when the length of the bins changes
+void RateAlarm::reset()
+{
+  _bg = 0;
+  _n = 0;
+  _n_alarm = 0;
+  _s = 0;
+  _alarm = 0;
+}
+
+// Test the count of the last bin, returns the alarm
+// len is the length of the bin over the usual one, for the bins that are
+// stretched or shortened.
+byte RateAlarm::add(unsigned long count, float len)
+{
+  float bg;
+
+  // no test until the background is known
+  if (_n < RA_LEARN)
+  {
+    _n++;
+    _bg += (count / len - _bg) / _n;
+    return 0;
+  }
+
+  bg = _bg;
+  if (bg < RA_BG_MIN)
+    bg = RA_BG_MIN;
+
+  // log likelihood ratio of rate RA_GAIN * bg to rate bg for this count
+  _s += count * RA_LOG_GAIN - bg * len * (RA_GAIN - 1);
+  if (_s < 0)
+    _s = 0;
+  else if (_s > 2 * RA_H)
+    _s = 2 * RA_H;
+
+  _alarm = (_s > RA_H);
+
+  // a rise that lasts is the new background
+  if (!_alarm)
+    _n_alarm = 0;
+  else if (++_n_alarm >= RA_RELEARN)
+  {
+    reset();
+    return 0;
+  }
+
+  // the background does not follow the hotspots, nor only the low bins
+  if (_s <= RA_H / 2)
+    _bg += (count / len - _bg) / RA_EWMA;
+
+  return _alarm;
+}
+
+// 1 while the rate is significantly over the background
+byte RateAlarm::alarm()
+{
+  return _alarm;
+}
+
+// 1 when the background is known and the test runs
+byte RateAlarm::ready()
+{
+  return _n >= RA_LEARN;
+}
+
+// Background in counts per bin
+float RateAlarm::background()
+{
+  return _bg;
+}
+
+// Score of the test, the alarm is on over RA_H
+float RateAlarm::score()
+{
+  return _s;
+}
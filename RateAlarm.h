@@ -0,0 +1,83 @@
+/*
+   Alarm on a significant increase of the count rate
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RATEALARM_H
+#define RATEALARM_H
+
+// Link to arduino library
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#define RA_GAIN     2.0       // increase of the rate the test looks for
+#define RA_LOG_GAIN 0.693147  // log(RA_GAIN)
+#define RA_H        7.0       // threshold of the test, in log likelihood
+#define RA_LEARN    12        // bins averaged for the first background
+#define RA_EWMA     64        // then the background follows over this many bins
+#define RA_BG_MIN   0.5       // lowest background in counts per bin
+#define RA_RELEARN  120       // bins of alarm after which the background is learned again
+
+// CUSUM test of the count of each bin against the background
+// Each bin adds to the score the log likelihood ratio of a Poisson rate
+// RA_GAIN times the background to the background itself, the score does
+// not go below 0. The alarm is on while the score is over RA_H: a bin of
+// many counts gives the alarm right away, a smaller increase after a few
+// bins. The score is limited to twice RA_H so that the alarm ends a few bins
+// after the rate is back to the background.
+// The background is the mean of the first RA_LEARN bins, then a moving
+// average over RA_EWMA bins. It stops while the score is over half RA_H
+// so that it does not learn the hotspots. Learning only at a score of 0
+// would take the bins under the mean only and lower the background.
+// A rise that lasts keeps the score at the limit and the background would
+// never follow, the alarm would stay on. After RA_RELEARN bins of alarm in
+// a row, 10 minutes with 5 s bins, the new rate is taken as the
+// background: the alarm ends and the background is learned again as at
+// the start. A hotspot longer than that only gives an alarm at its start.
+class RateAlarm
+{
+  public:
+    RateAlarm();
+    void reset();
+    byte add(unsigned long count, float len = 1.0);
+    byte alarm();
+    byte ready();
+    float background();
+    float score();
+
+  private:
+    float _bg;                // background in counts per bin
+    unsigned int _n;          // bins in the first background, up to RA_LEARN
+    unsigned int _n_alarm;    // bins of alarm in a row
+    float _s;                 // score of the test
+    byte _alarm;
+};
+
+#endif /* RATEALARM_H */
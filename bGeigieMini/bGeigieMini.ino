@@ -125,6 +125,7 @@ static const int pinBoost = 2;
 
 unsigned long shift_reg[NX] = {0};
 unsigned long reg_index = 0;
+unsigned long cpm_sum = 0;     // running sum of shift_reg
 unsigned long total_count = 0;
 int str_count = 0;
 char geiger_status = VOID;
@@ -284,9 +285,11 @@ void loop()
       interruptCounterReset();
 
       // insert count in sliding window and compute CPM
+      // the running sum takes out the bin that leaves the window
+      cpm_sum += cpb - shift_reg[reg_index];
       shift_reg[reg_index] = cpb;     // put the count in the correct bin
       reg_index = (reg_index+1) % NX; // increment register index
-      cpm = cpm_gen();                // compute sum over all bins
+      cpm = cpm_sum;                  // sum over all bins
 
       // update the total counter
       total_count += cpb;
@@ -516,24 +519,6 @@ byte bg_status_str_gen(char *buf)
 }
 #endif
 
-
-/**************************************************************************/
-/*!
-
-*/
-/**************************************************************************/
-unsigned long cpm_gen()
-{
-   unsigned int i;
-   unsigned long c_p_m = 0;
-   
-   // sum up
-   for (i=0 ; i < NX ; i++)
-     c_p_m += shift_reg[i];
-   
-   return c_p_m;
-}
-
 void pullDevId()
 {
   // counter for trials of reading EEPROM
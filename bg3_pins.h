@@ -73,6 +73,7 @@ static const int gps_1pps = 25; // A1
 // Geiger counter
 static const int counts = 1;
 static const int counts_int = 2;
+static const int counts2 = 8;    // second tube, T3 of Timer3 on PD0 along with RXD0
 static const int hvps_pwr = 27; // A3
 
 // turn on and off high voltage power supply
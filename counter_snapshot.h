@@ -0,0 +1,76 @@
+/*
+   Race free snapshots of the pulse counters
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COUNTER_SNAPSHOT_H
+#define COUNTER_SNAPSHOT_H
+
+// Link to arduino library
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+// Count of a 16 bit timer extended to 32 bits
+// ext is the volatile high part, the overflow interrupt adds 0x10000 to it.
+// With interrupts off, an overflow that happened since the interrupt last
+// ran shows as the TOV flag still set. It is added here when the timer
+// value was read after the overflow, i.e. when it is small.
+static inline unsigned long counter_snapshot16(volatile uint16_t *tcnt,
+    volatile uint8_t *tifr, uint8_t tov, volatile unsigned long *ext)
+{
+  unsigned long hi;
+  unsigned int cnt;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  cnt = *tcnt;
+  hi = *ext;
+  if ((*tifr & _BV(tov)) && cnt < 0x8000)
+    hi += 0x10000;
+  SREG = oldSREG;
+
+  return hi + cnt;
+}
+
+// Count of a 32 bit counter incremented by an interrupt
+// The four bytes are read with interrupts off.
+static inline unsigned long counter_snapshot32(volatile unsigned long *cnt)
+{
+  unsigned long v;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  v = *cnt;
+  SREG = oldSREG;
+
+  return v;
+}
+
+#endif /* COUNTER_SNAPSHOT_H */
@@ -0,0 +1,79 @@
+/*
+   Dead time correction of the counts of the Geiger tube
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEAD_TIME_H
+#define DEAD_TIME_H
+
+// Link to arduino library
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+// largest correction, the model does not hold when the tube is saturated
+#define DEAD_TIME_GAIN_MAX 16
+
+// Counts of a bin corrected for the dead time of the tube
+// Non-paralyzable model: each count makes the tube blind for tau_us, so
+// that the true count is n = m * T / (T - m * tau) for m counts in a bin
+// of T. The times are scaled to 16 bits so that the ratio is computed in
+// 32 bit integers, with about 5 significant digits. The gain is limited to
+// DEAD_TIME_GAIN_MAX when m * tau gets close to T. tau_us = 0 gives m.
+static inline unsigned long dead_time_correct(unsigned long m, unsigned long bin_ms, unsigned int tau_us)
+{
+  unsigned long t, dead, live, g;
+
+  if (tau_us == 0 || m == 0 || bin_ms == 0)
+    return m;
+
+  // bin and dead time in us, the dead time is at most the bin
+  t = bin_ms * 1000;
+  if (m >= t / tau_us)
+    dead = t;
+  else
+    dead = m * tau_us;
+
+  // 16 bits are enough for the ratio
+  while (t >= 0x10000UL)
+  {
+    t >>= 1;
+    dead >>= 1;
+  }
+
+  live = t - dead;
+  if (live < t / DEAD_TIME_GAIN_MAX)
+    live = t / DEAD_TIME_GAIN_MAX;
+
+  // gain T / (T - m * tau) in 16.16 fixed point, then m * gain
+  g = (t << 16) / live;
+  return m * (g >> 16) + (m >> 16) * (g & 0xFFFF) + (((m & 0xFFFF) * (g & 0xFFFF)) >> 16);
+}
+
+#endif /* DEAD_TIME_H */
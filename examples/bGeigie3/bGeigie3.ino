@@ -45,7 +45,12 @@
 // Safecast bGeigie library
 #include <bg3_pins.h>
 #include <GPS.h>
+#include <gps_epo.h>
 #include <HardwareCounter.h>
+#include <CountWindows.h>
+#include <dead_time.h>
+#include <RateAlarm.h>
+#include <PulseTimer.h>
 #include <sd_logger.h>
 #include <bg_sensors.h>
 
@@ -63,19 +68,50 @@
 #define AVAILABLE 'A'          // indicates geiger data are ready (available)
 #define VOID      'V'          // indicates geiger data not ready (void)
 
-/* moving average length and number of bins (NX) */
-#define TIME_INTERVAL 5000
-#define NX 12
+/* GPS serial rate, raised for the 10 Hz mode */
+#if GPS_HIGH_RATE_ENABLE
+#define GPS_BAUD 57600
+#else
+#define GPS_BAUD 9600
+#endif
 
 // Geiger rolling and total count
-unsigned long shift_reg[NX] = {0};
-unsigned long reg_index = 0;
+// the length of the bins and windows are set by the configuration,
+// BinSec and Windows
+CountWindows cw;
+CountWindows cw_dt;             // the first window, corrected for the dead time
+RateAlarm ra;                   // increase of the counts over the background
+unsigned long bin_ms = CONFIG_BS_DEFAULT * 1000UL;
 unsigned long total_count = 0;
-int str_count = 0;
 char geiger_status = VOID;
 
 // Hardware counter
-static HardwareCounter hwc(counts, TIME_INTERVAL);
+static HardwareCounter hwc(counts, CONFIG_BS_DEFAULT * 1000L);
+
+// Bins are closed by the counter interrupt, on UTC time edges when the
+// GPS time is known
+bin_t bin;                      // last bin read from the counter
+unsigned long bin_time;         // UTC time at the end of the bin, seconds from 1970
+
+// The second tube, its own bins of the same length, on the same edges
+#if TUBE2_ENABLE
+static TimerCounter<Timer3> hwc2(counts2, CONFIG_BS_DEFAULT * 1000L);
+CountWindows cw2;               // the first window
+bin_t bin2;                     // last bin read from the counter
+unsigned long cpb2 = 0;
+#endif
+
+// Timestamps of the pulses, the counter pin is on external interrupt 2
+#if PULSE_HIST_ENABLE
+static PulseTimer ptm(counts_int);
+#endif
+
+// position written in the record
+gps_track_t track;              // fixes aggregated over the bin
+char rec_lat[LAT_SZ];
+char rec_lat_hem[DEFAULT_SZ];
+char rec_lon[LON_SZ];
+char rec_lon_hem[DEFAULT_SZ];
 
 // the line buffer for serial1 and GPS
 static char gps_line[LINE_SZ];
@@ -84,6 +120,9 @@ static char gps_line[LINE_SZ];
 #define SERIAL_LINE_SIZE 256
 static char line[SERIAL_LINE_SIZE];
 
+// the line buffer for the track sentence (high rate GPS mode)
+#define TRK_LINE_SZ 80
+
 /* files name */
 char filename[18];              // placeholder for filename
 char ext_log[] = ".log";
@@ -97,6 +136,10 @@ int rtc_acq = 0;
 int log_created = 0;
 unsigned int battery_voltage = 0;
 
+// GPS time to first fix
+unsigned long gps_on_time = 0;  // millis() when GPS was turned on
+unsigned long gps_ttff = 0;     // 0 until the first fix
+
 // radio variables
 #if RADIO_ENABLE
 uint8_t radio_init_status = 0;
@@ -112,30 +155,86 @@ void global_variables_init()
 {
   rtc_acq = 0;
   log_created = 0;
-
-  for (int i = 0 ; i < NX ; i++)
-    shift_reg[i] = 0;
-  reg_index = 0;
+  gps_ttff = 0;
+
+  cw.reset();
+  cw_dt.reset();
+  ra.reset();
+#if TUBE2_ENABLE
+  cw2.reset();
+  cpb2 = 0;
+#endif
 
   total_count = 0;
-  str_count = 0;
   geiger_status = VOID;
 }
 
-// Standard GPS setup. GGA/RMC, 1Hz, SBAS, DGPS WAAS
-void gps_setup()
+// Start the counter with the bins and windows of the configuration
+// Called again by the config command when they change.
+void count_setup()
 {
-  char tmp[100];
+  uint16_t win_dt[CW_WIN_MAX] = { theConfig.window_s[0] };
+
+  // the configuration was checked by cfgSetDefault() or the config command
+  if (cw.setup(theConfig.bin_s, theConfig.window_s))
+  {
+    cw_dt.setup(theConfig.bin_s, win_dt);
+    ra.reset();               // the background is in counts per bin
+    bin_ms = theConfig.bin_s * 1000UL;
+    hwc.set_delay(bin_ms);
+#if TUBE2_ENABLE
+    cw2.setup(theConfig.bin_s, win_dt);
+    hwc2.set_delay(bin_ms);
+#endif
+  }
+  geiger_status = VOID;
 
-  // Issue some commands to the GPS
-  strcpy_P(tmp, PSTR(MTK_SET_NMEA_OUTPUT_RMCGGA));
-  gps_send_command(tmp); // Set output to RMC and GGA
-  strcpy_P(tmp, PSTR(MTK_UPDATE_RATE_1HZ));
-  gps_send_command(tmp); // Output rate at 1 Hz
-  strcpy_P(tmp, PSTR(SBAS_ENABLE));
-  gps_send_command(tmp); // Enable SBAS
-  strcpy_P(tmp, PSTR(DGPS_WAAS_ON));
-  gps_send_command(tmp); // Enable DGPS WAAS
+#if TUBE2_ENABLE
+  // T3 is the receive pin of the serial port
+  UCSR0B &= ~_BV(RXEN0);
+
+  // both counters start on the same millis(), their bins end in the same
+  // interrupt and are read in pairs
+  hwc.setup();
+  hwc2.setup();
+  uint8_t oldSREG = SREG;
+  cli();
+  hwc.clear();
+  hwc2.clear();
+  SREG = oldSREG;
+  hwc.schedule();
+  hwc2.schedule();
+#else
+  hwc.start();
+  hwc.schedule();
+#endif
+#if PULSE_HIST_ENABLE
+  ptm.start();
+#endif
+}
+
+// Standard GPS setup. GGA/RMC, 1Hz (10Hz in high rate mode), SBAS, DGPS WAAS
+// The commands are queued and sent from gps_update() as the GPS acknowledges them
+void gps_setup()
+{
+#if GPS_UBX_ENABLE
+  gps_ubx_nmea_off();                            // u-blox, NAV-PVT instead of NMEA
+#else
+#if GPS_HIGH_RATE_ENABLE
+  gps_command(PSTR(MTK_BAUDRATE_57600));         // Serial1 follows the GPS
+#endif
+  gps_command(PSTR(MTK_SET_NMEA_OUTPUT_RMCGGA)); // Set output to RMC and GGA
+#if GPS_HIGH_RATE_ENABLE
+  gps_command(PSTR(MTK_UPDATE_RATE_10HZ));       // Output rate at 10 Hz
+#else
+  gps_command(PSTR(MTK_UPDATE_RATE_1HZ));        // Output rate at 1 Hz
+#endif
+  gps_command(PSTR(SBAS_ENABLE));                // Enable SBAS
+  gps_command(PSTR(DGPS_WAAS_ON));               // Enable DGPS WAAS
+#if GPS_POWER_SAVE_ENABLE
+  gps_power_auto(1);                             // Low power when not moving
+#endif
+#endif
 }
 
 /* SETUP */
@@ -160,11 +259,19 @@ void setup()
   gps_init(&Serial1, gps_line);
   bg_gps_pwr_config();
   bg_gps_on();
+  gps_on_time = millis();
 
+  // GPS 1PPS gives the exact start of the UTC seconds
+  pinMode(gps_1pps, INPUT);
+  BG_1PPS_INTP();
+
+  // wait for the startup message of the GPS
   int t = 0;
-  while(!Serial1.available() && t < 100)
+  gps_update();
+  while(!(gps_mtk_status() & GPS_MTK_STARTUP) && t < 100)
   {
     delay(10);
+    gps_update();
     t++;
   }
   strcpy_P(tmp, PSTR("GPS start time,"));
@@ -192,6 +299,10 @@ void setup()
   // initialize SD card
   sd_log_init(sd_pwr, sd_detect, cs_sd);
 
+  // upload GPS assistance data if present on the SD card
+  strcpy_P(tmp, PSTR(GPS_EPO_FILE));
+  gps_epo_start(tmp, GPS_BAUD);
+
   // initialize sensors
   bgs_sensors_init(sense_pwr, batt_sense, temp_sense, hum_sense, hv_sense);
   
@@ -217,7 +328,7 @@ void setup()
   bg_hvps_on();
 
   // And now Start the Pulse Counter!
-  hwc.start();
+  count_setup();
 
   // setup command line commands
 #if CMD_LINE_ENABLE
@@ -282,7 +393,7 @@ void loop()
     {
       blinky(BLINK_PROBLEM);
     }
-    else if (gps_getData()->status[0] == 'A')
+    else if (gps_getFix()->status & GPS_FIX_VALID)
     {
       blinky(BLINK_ALL_OK);
     }
@@ -298,143 +409,227 @@ void loop()
 
     // update gps
     gps_update();
+    gps_epo_update();
+
+#if PULSE_HIST_ENABLE
+    // intervals between the pulses timestamped since the last pass
+    ptm.process();
+#endif
+
+    // measure time to first fix
+    if (gps_ttff == 0 && (gps_getFix()->status & GPS_FIX_VALID))
+    {
+      gps_ttff = millis() - gps_on_time;
+      if (rtc_acq)
+        writeTTFF2SD(filename);   // the header was written before the fix
+    }
 
-    // generate CPM every TIME_INTERVAL seconds
-    if (hwc.available())
+    // generate CPM at the end of every bin, 5 seconds by default
+    // the counter interrupt closes the bins and queues them, they keep
+    // their length when the loop is late. The bins are moved onto UTC
+    // time edges when the time is known.
+    if (gps_available() && hwc.get_bin(&bin))
     {
-      if (gps_available())
+      unsigned long cpm=0, cpb=0, cpm_dt=0, cpm_ad=0, edge;
+      byte line_len, alarm;
+
+      // the UTC time at the end of the bin, on the second, or the time
+      // of the last RMC without UTC time
+      bin_time = gps_utc_at(bin.end + 500);
+      if (bin_time == 0)
+        bin_time = gps_utc_seconds(gps_getFix()->date, gps_getFix()->time);
+      if (gps_utc_next_edge(bin_ms, &edge))
       {
-        unsigned long cpm=0, cpb=0;
-        byte line_len;
-
-        // obtain the count in the last bin
-        cpb = hwc.count();
-
-        // reset the pulse counter
-        hwc.start();
-
-        // insert count in sliding window and compute CPM
-        shift_reg[reg_index] = cpb;     // put the count in the correct bin
-        reg_index = (reg_index+1) % NX; // increment register index
-        cpm = cpm_gen();                // compute sum over all bins
-
-        // update the total counter
-        total_count += cpb;
-        
-        // set status of Geiger
-        if (str_count < NX)
-        {
-          geiger_status = VOID;
-          str_count++;
-        } else if (cpm == 0) {
-          geiger_status = VOID;
-        } else {
-          geiger_status = AVAILABLE;
-        }
-
-
-        // check the RTC is correct
-        // by default, we check that the year is not 1980 (default GPS module year)
-        // obviously this won't work past 2079
-        // to ensure GPS will work in the year 2080, we also condition on fix status
-        // in every year other than xx80, the system starts recording when year is not '80' (i.e. RTC running)
-        // in xx80, it only starts when a fix is acquired.
-        if (rtc_acq == 0 && ( gps_getData()->status[0] == 'A' || strncmp(gps_getData()->datetime.year, "80", 2) != 0) )
-        {
-          // flag GPS acquired
-          rtc_acq = 1;
-
-          // Create the filename for that drive
-          strcpy(filename, "20");
-          strncat(filename, gps_getData()->datetime.year, 2);
-
-          // create the directory (if necessary)
-          SD.mkdir(filename);
-
-          // create the rest of the file name
-          strcat(filename, "/");
-          sprintf(filename + strlen(filename), "%x", theConfig.id & 0xFFF); // limit to 3 last digit
-          strcat(filename, "-");
-          strncat(filename, gps_getData()->datetime.month, 2);
-          strncat(filename, gps_getData()->datetime.day, 2);
-          strncat(filename, ext_log, 4);
-
-          // write to log file on SD card
-          writeHeader2SD(filename);
-        }
-        
-        // truncate the GPS coordinates if the configuration says so (default disabled)
-        if (theConfig.coord_truncation)
-        {
-          gps_t *ptr = gps_getData();
-          truncate_JP(ptr->lat, ptr->lon);
-        }
-  
-        // generate timestamp. only update the start time if 
-        // we printed the timestamp. otherwise, the GPS is still 
-        // updating so wait until its finished and generate timestamp
-        line_len = gps_gen_timestamp(line, shift_reg[reg_index], cpm, cpb);
-        
-        if (rtc_acq == 0)
-        {
-          sd_log_last_write = 0;   // because we don't write to SD before GPS lock
-          if (theConfig.serial_output)
-            Serial.print("No GPS: ");
-        }
-        else
-        {
-          // dump data to SD card
-          sd_log_writeln(filename, line);
-        }
+        hwc.align(edge);
+#if TUBE2_ENABLE
+        hwc2.align(edge);
+#endif
+      }
+
+      // the count in the bin, the counter keeps running
+      cpb = bin.count;
+
+#if TUBE2_ENABLE
+      // the bin of the second tube that ends in the same interrupt, one
+      // for each bin of the first tube. Older bins would come from counters
+      // out of step and are dropped.
+      while (hwc2.get_bin(&bin2) && (long)(bin2.end - bin.end) < 0)
+        ;
+      if (bin2.end == bin.end)
+      {
+        cpb2 = bin2.count;
+        cw2.add(cpb2);
+      }
+#endif
+
+      // fixes received during the bin
+      gps_track_get(&track);
+
+      // insert count in the moving windows, the first one gives the CPM
+      cw.add(cpb);
+      cpm = cw.cpm(0);
+
+      // the adaptive window follows hotspots within a bin or two
+      cpm_ad = cw.adaptive_cpm();
+
+      // test the bin against the background, the alarm goes out by radio
+      alarm = ra.add(cpb, (float)(bin.end - bin.start) / bin_ms);
+
+      // the same corrected for the dead time of the tube, bin by bin
+      cw_dt.add(dead_time_correct(cpb, bin.end - bin.start, theConfig.dead_time_us));
+      cpm_dt = cw_dt.cpm(0);
+
+      // update the total counter
+      total_count += cpb;
+      
+      // set status of Geiger
+      if (!cw.full(0) || cpm == 0)
+        geiger_status = VOID;
+      else
+        geiger_status = AVAILABLE;
+
+
+      // check the RTC is correct
+      // by default, we check that the year is not 1980 (default GPS module year)
+      // obviously this won't work past 2079
+      // to ensure GPS will work in the year 2080, we also condition on fix status
+      // in every year other than xx80, the system starts recording when year is not '80' (i.e. RTC running)
+      // in xx80, it only starts when a fix is acquired.
+      if (rtc_acq == 0 && ( (gps_getFix()->status & GPS_FIX_VALID) || GPS_DATE_YEAR(gps_getFix()->date) != 1980) )
+      {
+        // flag GPS acquired
+        rtc_acq = 1;
+
+        // Create the filename for that drive
+        strcpy(filename, "20");
+        strncat(filename, gps_getData()->datetime.year, 2);
+
+        // create the directory (if necessary)
+        SD.mkdir(filename);
+
+        // create the rest of the file name
+        strcat(filename, "/");
+        sprintf(filename + strlen(filename), "%x", theConfig.id & 0xFFF); // limit to 3 last digit
+        strcat(filename, "-");
+        strncat(filename, gps_getData()->datetime.month, 2);
+        strncat(filename, gps_getData()->datetime.day, 2);
+        strncat(filename, ext_log, 4);
+
+        // write to log file on SD card
+        writeHeader2SD(filename);
+      }
+      
+      // position of the record, the mean over the bin in high rate mode
+      rec_position_gen();
+
+      // truncate the GPS coordinates if the configuration says so (default disabled)
+      if (theConfig.coord_truncation)
+        truncate_JP(rec_lat, rec_lon);
+
+      // generate timestamp. only update the start time if 
+      // we printed the timestamp. otherwise, the GPS is still 
+      // updating so wait until its finished and generate timestamp
+      line_len = gps_gen_timestamp(line, cpm, cpb, cpm_dt, cpm_ad, alarm);
+      
+      if (rtc_acq == 0)
+      {
+        sd_log_last_write = 0;   // because we don't write to SD before GPS lock
+        if (theConfig.serial_output)
+          Serial.print("No GPS: ");
+      }
+      else
+      {
+        // dump data to SD card
+        sd_log_writeln(filename, line);
+#if GPS_HIGH_RATE_ENABLE
+        // followed by the track over the bin
+        char trk[TRK_LINE_SZ];
+        gps_track_str_gen(trk);
+        sd_log_writeln(filename, trk);
+#endif
+      }
 
 #if RADIO_ENABLE
-        // send out wirelessly. first wake up the radio, do the transmit, then go back to sleep
-        if (radio_init_status)  // but only if it initialized properly
-        {
-          chibiSleepRadio(0);
-          delay(10);
-          chibiTx(DEST_ADDR, (byte *)line, LINE_SZ);
-          chibiSleepRadio(1);
-        }
+      // send out wirelessly. first wake up the radio, do the transmit, then go back to sleep
+      // a sentence longer than a radio frame is split in several frames
+      if (radio_init_status)  // but only if it initialized properly
+      {
+        chibiSleepRadio(0);
+        delay(10);
+        chibiTx(DEST_ADDR, (byte *)line, strlen(line) + 1);
+        chibiSleepRadio(1);
+      }
 #endif
 
-        // output through Serial too
+      // output through Serial too
+      if (theConfig.serial_output)
+        Serial.println(line);
+
+      // the CPM of all windows, when there are more than one
+      if (cw.windows() > 1)
+      {
+        line_len = windows_str_gen(line);
+        if (rtc_acq != 0)
+          sd_log_writeln(filename, line);
         if (theConfig.serial_output)
           Serial.println(line);
+      }
 
-        // Now take care of the Status message
-        line_len = bg_status_str_gen(line);
-
-        // write to status to SD
+#if PULSE_HIST_ENABLE
+      // the histogram of the intervals between pulses, then a new one
+      if (ptm.elapsed() >= PULSE_HIST_PERIOD * 1000UL)
+      {
+        line_len = hist_str_gen(line);
+        ptm.clear();
         if (rtc_acq != 0)
           sd_log_writeln(filename, line);
-
-#if RADIO_ENABLE
-        // send out wirelessly. first wake up the radio, do the transmit, then go back to sleep
-        if (radio_init_status)  // but only if it initialized properly
-        {
-          chibiSleepRadio(0);
-          delay(10);
-          chibiTx(DEST_ADDR, (byte *)line, LINE_SZ);
-          chibiSleepRadio(1);
-        }
-  #endif
-      
-        // show in Serial stream
         if (theConfig.serial_output)
           Serial.println(line);
+      }
+#endif
+
+      // Now take care of the Status message
+      line_len = bg_status_str_gen(line);
 
-      } /* gps_available */
-    } /* hwc_available */
+      // write to status to SD
+      if (rtc_acq != 0)
+        sd_log_writeln(filename, line);
+
+#if RADIO_ENABLE
+      // send out wirelessly. first wake up the radio, do the transmit, then go back to sleep
+      // a sentence longer than a radio frame is split in several frames
+      if (radio_init_status)  // but only if it initialized properly
+      {
+        chibiSleepRadio(0);
+        delay(10);
+        chibiTx(DEST_ADDR, (byte *)line, strlen(line) + 1);
+        chibiSleepRadio(1);
+      }
+#endif
+    
+      // show in Serial stream
+      if (theConfig.serial_output)
+        Serial.println(line);
+
+    } /* get_bin */
 
   } /* sd_reader_lock */
 #if SD_READER_ENABLE
   else
   {
-    // always restart the pulse counter when in SD reader mode
+    // always drop the pulse count when in SD reader mode
     // that way pulse count doesn't accumulate while being in
     // SD reader mode.
-    hwc.start();
+    while (hwc.get_bin(&bin))
+    {
+#if TUBE2_ENABLE
+      hwc2.get_bin(&bin2);    // in pairs, as in the loop
+#endif
+    }
+#if PULSE_HIST_ENABLE
+    ptm.process();
+    ptm.clear();
+#endif
 
     // also, we turn the LED off
     blinky(BLINK_OFF);
@@ -445,30 +640,53 @@ void loop()
 
 }
 
+/* filter result of the last fix: 0 accepted, 1 rejected, 2 held */
+byte gps_filter_flag(byte status)
+{
+  if (status & GPS_FIX_REJECTED)
+    return 1;
+  if (status & GPS_FIX_HELD)
+    return 2;
+  return 0;
+}
+
 /* generate log line */
-byte gps_gen_timestamp(char *buf, unsigned long counts, unsigned long cpm, unsigned long cpb)
+byte gps_gen_timestamp(char *buf, unsigned long cpm, unsigned long cpb, unsigned long cpm_dt, unsigned long cpm_ad, byte alarm)
 {
   byte len;
   byte chk;
+  char date[GPS_ISO8601_SZ];
 
   gps_t *ptr = gps_getData();
+  gps_iso8601(date, bin_time);
 
   memset(buf, 0, LINE_SZ);
-  sprintf_P(buf, PSTR("$%s,%lx,20%s-%s-%sT%s:%s:%sZ,%ld,%ld,%ld,%c,%s,%s,%s,%s,%s,%s,%s,%s"),  \
+  sprintf_P(buf, PSTR("$%s,%lx,%s,%ld,%ld,%ld,%c,%s,%s,%s,%s,%s,%s,%s,%s,%d,%ld,%ld,%d"),  \
               hdr, \
               (unsigned long)theConfig.id, \
-              ptr->datetime.year, ptr->datetime.month, ptr->datetime.day,  \
-              ptr->datetime.hour, ptr->datetime.minute, ptr->datetime.second, \
+              date, \
               cpm, \
               cpb, \
               total_count, \
               geiger_status, \
-              ptr->lat, ptr->lat_hem, \
-              ptr->lon, ptr->lon_hem, \
+              rec_lat, rec_lat_hem, \
+              rec_lon, rec_lon_hem, \
               ptr->altitude, \
               ptr->status, \
               ptr->precision, \
-              ptr->quality);
+              ptr->quality, \
+              gps_filter_flag(ptr->fix.status), \
+              cpm_dt, \
+              cpm_ad, \
+              alarm);
+
+   // the second tube, empty fields without it
+#if TUBE2_ENABLE
+   len = strlen(buf);
+   sprintf_P(buf + len, PSTR(",%ld,%ld"), cw2.cpm(0), cpb2);
+#else
+   strcat_P(buf, PSTR(",,"));
+#endif
    len = strlen(buf);
    buf[len] = '\0';
 
@@ -484,6 +702,65 @@ byte gps_gen_timestamp(char *buf, unsigned long counts, unsigned long cpm, unsig
    return len;
 }
 
+/* position of the record, mean of the fixes of the bin in high rate mode */
+void rec_position_gen()
+{
+  gps_t *ptr = gps_getData();
+
+#if GPS_HIGH_RATE_ENABLE
+  if (track.n_fix > 0)
+  {
+    gps_format_coord(rec_lat, track.lat, 2);
+    rec_lat_hem[0] = (track.lat < 0) ? 'S' : 'N';
+    rec_lat_hem[1] = '\0';
+    gps_format_coord(rec_lon, track.lon, 3);
+    rec_lon_hem[0] = (track.lon < 0) ? 'W' : 'E';
+    rec_lon_hem[1] = '\0';
+    return;
+  }
+#endif
+
+  strcpy(rec_lat, ptr->lat);
+  strcpy(rec_lat_hem, ptr->lat_hem);
+  strcpy(rec_lon, ptr->lon);
+  strcpy(rec_lon_hem, ptr->lon_hem);
+}
+
+#if GPS_HIGH_RATE_ENABLE
+/* create track log line: number of fixes, distance (m), altitude range (m) */
+byte gps_track_str_gen(char *buf)
+{
+  byte len;
+  byte chk;
+
+  sprintf_P(buf, PSTR("$BNXTRK,%lx,%u,%lu.%lu,"), \
+              (unsigned long)theConfig.id, \
+              track.n_fix, \
+              track.distance / 100, (track.distance / 10) % 10);
+  len = strlen(buf);
+  len += sprintf_dm(buf + len, track.alt_min);
+  buf[len++] = ',';
+  len += sprintf_dm(buf + len, track.alt_max);
+
+  chk = gps_checksum(buf+1, len);
+  if (chk < 16)
+    sprintf(buf + len, "*0%X", (int)chk);
+  else
+    sprintf(buf + len, "*%X", (int)chk);
+
+  return len;
+}
+
+/* print decimeters as meters with one decimal */
+byte sprintf_dm(char *buf, long dm)
+{
+  if (dm < 0)
+    return sprintf_P(buf, PSTR("-%ld.%ld"), -dm / 10, -dm % 10);
+  else
+    return sprintf_P(buf, PSTR("%ld.%ld"), dm / 10, dm % 10);
+}
+#endif
+
 /* create Status log line */
 byte bg_status_str_gen(char *buf)
 {
@@ -513,16 +790,17 @@ byte bg_status_str_gen(char *buf)
 
   // get GPS data
   gps_t *ptr = gps_getData();
+  char date[GPS_ISO8601_SZ];
+  gps_iso8601(date, gps_utc_seconds(ptr->fix.date, ptr->fix.time));
 
   // create string
   memset(buf, 0, LINE_SZ);
   if (theConfig.hv_sense)
   {
-    sprintf_P(buf, PSTR("$%s,%lx,20%s-%s-%sT%s:%s:%sZ,%s,%s,%s,%s,%s,v%s,%d,%d,%d,%d,%d,%d,%d"),  \
+    sprintf_P(buf, PSTR("$%s,%lx,%s,%s,%s,%s,%s,%s,v%s,%d,%d,%d,%d,%d,%d,%d,%d"),  \
         hdr_status, \
         (unsigned long)theConfig.id, \
-        ptr->datetime.year, ptr->datetime.month, ptr->datetime.day,  \
-        ptr->datetime.hour, ptr->datetime.minute, ptr->datetime.second, \
+        date, \
         ptr->lat, ptr->lat_hem, \
         ptr->lon, ptr->lon_hem, \
         ptr->num_sat, \
@@ -531,15 +809,15 @@ byte bg_status_str_gen(char *buf)
         (int)h,  \
         batt, \
         hv, \
-        sd_log_inserted, sd_log_initialized, sd_log_last_write);
+        sd_log_inserted, sd_log_initialized, sd_log_last_write, \
+        gps_power_low_share());
   }
   else
   {
-    sprintf_P(buf, PSTR("$%s,%lx,20%s-%s-%sT%s:%s:%sZ,%s,%s,%s,%s,%s,v%s,%d,%d,%d,,%d,%d,%d"),  \
+    sprintf_P(buf, PSTR("$%s,%lx,%s,%s,%s,%s,%s,%s,v%s,%d,%d,%d,,%d,%d,%d,%d"),  \
         hdr_status, \
         (unsigned long)theConfig.id, \
-        ptr->datetime.year, ptr->datetime.month, ptr->datetime.day,  \
-        ptr->datetime.hour, ptr->datetime.minute, ptr->datetime.second, \
+        date, \
         ptr->lat, ptr->lat_hem, \
         ptr->lon, ptr->lon_hem, \
         ptr->num_sat, \
@@ -547,7 +825,8 @@ byte bg_status_str_gen(char *buf)
         (int)t,  \
         (int)h,  \
         batt, \
-        sd_log_inserted, sd_log_initialized, sd_log_last_write);
+        sd_log_inserted, sd_log_initialized, sd_log_last_write, \
+        gps_power_low_share());
   }
   len = strlen(buf);
   buf[len] = '\0';
@@ -564,19 +843,61 @@ byte bg_status_str_gen(char *buf)
   return len;
 }
 
-/* compute total of rolling count */
-unsigned long cpm_gen()
+/* create windows log line: bin length, then length, CPM and status of each window */
+byte windows_str_gen(char *buf)
+{
+  byte len;
+  byte chk;
+  byte w;
+
+  len = sprintf_P(buf, PSTR("$BNXWIN,%lx,%u"), \
+              (unsigned long)theConfig.id, \
+              (unsigned int)theConfig.bin_s);
+  for (w = 0 ; w < cw.windows() ; w++)
+    len += sprintf_P(buf + len, PSTR(",%u,%lu,%c"), \
+              cw.length(w), cw.cpm(w), cw.full(w) ? AVAILABLE : VOID);
+
+  chk = gps_checksum(buf+1, len);
+  if (chk < 16)
+    sprintf(buf + len, "*0%X", (int)chk);
+  else
+    sprintf(buf + len, "*%X", (int)chk);
+
+  return len;
+}
+
+#if PULSE_HIST_ENABLE
+/* create histogram log line: length, number of intervals and status, then the intervals in each bin */
+byte hist_str_gen(char *buf)
 {
-   unsigned int i;
-   unsigned long c_p_m = 0;
-   
-   // sum up
-   for (i=0 ; i < NX ; i++)
-     c_p_m += shift_reg[i];
-   
-   return c_p_m;
+  byte len;
+  byte chk;
+  byte b;
+
+  len = sprintf_P(buf, PSTR("$BNXHST,%lx,%lu,%lu,%c"), \
+              (unsigned long)theConfig.id, \
+              ptm.elapsed() / 1000, \
+              ptm.intervals(), \
+              ptm.incomplete() ? VOID : AVAILABLE);
+  for (b = 0 ; b < PT_HIST_SZ ; b++)
+    len += sprintf_P(buf + len, PSTR(",%u"), ptm.hist(b));
+
+  chk = gps_checksum(buf+1, len);
+  if (chk < 16)
+    sprintf(buf + len, "*0%X", (int)chk);
+  else
+    sprintf(buf + len, "*%X", (int)chk);
+
+  return len;
 }
+#endif
 
+/* GPS 1PPS interrupt, on both edges */
+ISR(BG_1PPS_INT)
+{
+  if (digitalRead(gps_1pps) == HIGH)
+    gps_pps();
+}
 
 /***********************************/
 /* Power on and shutdown functions */
@@ -584,6 +905,7 @@ unsigned long cpm_gen()
 
 void power_up()
 {
+  char tmp[13];
 
 #if SD_READER_ENABLE
   if (!sd_reader_interrupted)
@@ -603,11 +925,21 @@ void power_up()
       Serial.read();
 
     // flush Serial1 (GPS) before restarting GPS
-    while(Serial1.available())
-      Serial1.read();
+    gps_flush();
+
+    // the GPS restarts at 9600 bps with its default output
+    Serial1.begin(9600);
 
     // turn GPS on and set status to not acquired yet
     bg_gps_on();
+    gps_on_time = millis();
+
+    // Setup the GPS again, rate and power mode included
+    gps_setup();
+
+    // upload GPS assistance data if present on the SD card
+    strcpy_P(tmp, PSTR(GPS_EPO_FILE));
+    gps_epo_start(tmp, GPS_BAUD);
 
     // initialize sensors
     bg_sensors_on();
@@ -637,7 +969,7 @@ void power_up()
     delay(10); // wait for power to stabilize
 
     // And now Start the Pulse Counter!
-    hwc.start();
+    count_setup();
 
     // Starting now!
     Serial.println("bGeigie powered on!");
@@ -653,6 +985,7 @@ void shutdown()
   // indicate something is happening
   blinky(BLINK_OFF);
 
+  gps_epo_stop();
   bg_gps_off();
   chibiSleepRadio(1);
   bg_hvps_off();
@@ -723,6 +1056,20 @@ void writeHeader2SD(char *filename)
 #endif
   sd_log_writeln(filename, tmp);
 
+#if TUBE2_ENABLE
+  strcpy_P(tmp, PSTR("# Second tube enabled,yes"));
+#else
+  strcpy_P(tmp, PSTR("# Second tube enabled,no"));
+#endif
+  sd_log_writeln(filename, tmp);
+
+#if PULSE_HIST_ENABLE
+  strcpy_P(tmp, PSTR("# Pulse histogram enabled,yes"));
+#else
+  strcpy_P(tmp, PSTR("# Pulse histogram enabled,no"));
+#endif
+  sd_log_writeln(filename, tmp);
+
   if (theConfig.hv_sense)
     strcpy_P(tmp, PSTR("# HV sense enabled,yes"));
   else
@@ -740,6 +1087,22 @@ void writeHeader2SD(char *filename)
     sd_log_writeln(filename, tmp);
   }
 
+  // GPS assistance data upload
+  sprintf_P(tmp, PSTR("# GPS EPO,%d,%u"), gps_epo_status(), gps_epo_records());
+  sd_log_writeln(filename, tmp);
+
+  // time to first fix, if the fix came before the RTC
+  if (gps_ttff != 0)
+    writeTTFF2SD(filename);
+
+}
+
+void writeTTFF2SD(char *filename)
+{
+  char tmp[30];
+
+  sprintf_P(tmp, PSTR("# GPS TTFF,%lums"), gps_ttff);
+  sd_log_writeln(filename, tmp);
 }
 
 /**********************/
@@ -795,6 +1158,12 @@ void diagnostics()
   // GPS
   gps_diagnostics();
 
+  strcpy_P(tmp, PSTR("GPS EPO,"));
+  Serial.print(tmp);
+  Serial.print(gps_epo_status());
+  Serial.print(',');
+  Serial.println(gps_epo_records());
+
   // SD card
   //sd_log_pwr_on();
   sd_log_card_diagnostic();  
@@ -28,6 +28,7 @@ void showConfig(config_t *cfg);
 // some functions define in the bGeigie3.ino file.
 extern void diagnostics();
 extern void gps_setup();
+extern void count_setup();
 
 /**************************/
 /* command line functions */
@@ -115,6 +116,7 @@ void cmdConfig(int arg_cnt, char **args)
       configFromFile(&theConfig);
     else
       goto help;
+    count_setup();
     Serial.println("Copied.");
 
     return;
@@ -171,6 +173,49 @@ void cmdConfig(int arg_cnt, char **args)
       goto help;
     return;
   }
+  else if (strcmp_P(args[1], BS_K) == 0 || strcmp_P(args[1], WN_K) == 0)
+  {
+    uint16_t win[CW_WIN_MAX];
+    uint8_t bin_s = theConfig.bin_s;
+
+    if (!parseWindows(args[2], win))
+      goto help;
+
+    if (strcmp_P(args[1], BS_K) == 0)
+    {
+      if (win[1] != 0 || win[0] > 0xFE)
+        goto help;
+      bin_s = (uint8_t)win[0];
+      memcpy(win, theConfig.window_s, sizeof(win));
+    }
+
+    // the bins and windows must fit together
+    if (!CountWindows::valid(bin_s, win))
+    {
+      strcpy_P(tmp, PSTR("The windows must be multiples of the bins, at most "));
+      Serial.print(tmp);
+      Serial.print(CW_BINS_MAX);
+      strcpy_P(tmp, PSTR(" bins, and the bins must divide a day."));
+      Serial.println(tmp);
+      return;
+    }
+    theConfig.bin_s = bin_s;
+    memcpy(theConfig.window_s, win, sizeof(win));
+
+    // the counts start over with the new bins
+    count_setup();
+    return;
+  }
+  else if (strcmp_P(args[1], DT_K) == 0)
+  {
+    char *endptr = args[2];
+    unsigned long v = strtoul(args[2], &endptr, 10);
+
+    if (*endptr != '\0' || endptr == args[2] || v >= CONFIG_DT_INVALID)
+      goto help;
+    theConfig.dead_time_us = (uint16_t)v;
+    return;
+  }
 
 help:
   strcpy_P(tmp, PSTR("Usage: config <cmd> [args]"));
@@ -191,6 +236,12 @@ help:
   Serial.println(tmp);
   strcpy_P(tmp, PSTR("  config SDRW [on/off]           Enable or disable write permission to SD card through reader."));
   Serial.println(tmp);
+  strcpy_P(tmp, PSTR("  config BinSec [s]              Set the length of the count bins in seconds."));
+  Serial.println(tmp);
+  strcpy_P(tmp, PSTR("  config Windows [s,s,s]         Set up to 3 CPM windows in seconds. The first one is logged as CPM."));
+  Serial.println(tmp);
+  strcpy_P(tmp, PSTR("  config DeadTime [us]           Set the dead time of the tube in microseconds, 0 for no correction."));
+  Serial.println(tmp);
   strcpy_P(tmp, PSTR("  config save                    Writes configuration to EEPROM and SD card."));
   Serial.println(tmp);
   strcpy_P(tmp, PSTR("  config save [eeprom/file]      Writes configuration to EEPROM or SD card."));
@@ -230,6 +281,22 @@ void showConfig(config_t *cfg)
   Serial.print(tmp);
   Serial.print(':');
   Serial.println(cfg->sd_rw);
+
+  strcpy_P(tmp, BS_K);
+  Serial.print(tmp);
+  Serial.print(':');
+  Serial.println(cfg->bin_s);
+
+  strcpy_P(tmp, WN_K);
+  Serial.print(tmp);
+  Serial.print(':');
+  sprintWindows(tmp, cfg->window_s);
+  Serial.println(tmp);
+
+  strcpy_P(tmp, DT_K);
+  Serial.print(tmp);
+  Serial.print(':');
+  Serial.println(cfg->dead_time_us);
 }
 
 void cmdPrintHelp(int arg_cnt, char **args)
@@ -256,8 +323,7 @@ void cmdDiagnostics(int arg_cnt, char **args)
 void cmdGPSFullCold(int arg_cnt, char **args)
 {
   char tmp[100];
-  strcpy_P(tmp, PSTR(MTK_FULL_COLD_START));
-  gps_send_command(tmp);
+  gps_command(PSTR(MTK_FULL_COLD_START));
   strcpy_P(tmp, PSTR("  Issued full cold restart command to the GPS."));
   Serial.println(tmp);
   gps_setup();
@@ -14,6 +14,9 @@ char PROGMEM SO_K[] = "SerialOutput";
 char PROGMEM CT_K[] = "CoordTrunc";
 char PROGMEM HV_K[] = "HVSense";
 char PROGMEM SD_K[] = "SDRW";
+char PROGMEM BS_K[] = "BinSec";
+char PROGMEM WN_K[] = "Windows";
+char PROGMEM DT_K[] = "DeadTime";
 
 /* config filename */
 char config_filename[] = CONFIG_FILE_NAME;
@@ -74,10 +77,26 @@ void config_init()
       theConfig.sd_rw = fromFile.sd_rw;
       rewrite_eeprom_flag = 1;
     }
+    if (fromFile.bin_s != theConfig.bin_s && fromFile.bin_s != CONFIG_BS_INVALID)
+    {
+      theConfig.bin_s = fromFile.bin_s;
+      rewrite_eeprom_flag = 1;
+    }
+    if (memcmp(fromFile.window_s, theConfig.window_s, sizeof(theConfig.window_s)) != 0 && fromFile.window_s[0] != CONFIG_WN_INVALID)
+    {
+      memcpy(theConfig.window_s, fromFile.window_s, sizeof(theConfig.window_s));
+      rewrite_eeprom_flag = 1;
+    }
+    if (fromFile.dead_time_us != theConfig.dead_time_us && fromFile.dead_time_us != CONFIG_DT_INVALID)
+    {
+      theConfig.dead_time_us = fromFile.dead_time_us;
+      rewrite_eeprom_flag = 1;
+    }
   }
 
   /* check all the values in EEPROM and set to default if necessary */
-  cfgSetDefault(&theConfig);
+  if (cfgSetDefault(&theConfig))
+    rewrite_eeprom_flag = 1;
 
   // write to EEPROM if necessary
   if (rewrite_eeprom_flag)
@@ -89,8 +108,11 @@ void config_init()
 }
 
 /* set default values if invalid */
-void cfgSetDefault(config_t *cfg)
+/* returns 1 when the bins, windows or dead time were set to default */
+int cfgSetDefault(config_t *cfg)
 {
+  int ret = 0;
+
   /* there is no a priori info on id value */
   /* for all other values, we can only check if boolean or not */
   if (!IS_BOOLEAN(cfg->serial_output))
@@ -101,6 +123,24 @@ void cfgSetDefault(config_t *cfg)
     cfg->hv_sense         = CONFIG_HV_DEFAULT;
   if (!IS_BOOLEAN(cfg->serial_output))
     cfg->sd_rw            = CONFIG_SD_DEFAULT;
+
+  /* the bins and windows are checked together, e.g. an old EEPROM without them */
+  if (!CountWindows::valid(cfg->bin_s, cfg->window_s))
+  {
+    cfg->bin_s = CONFIG_BS_DEFAULT;
+    cfg->window_s[0] = CONFIG_WN_DEFAULT;
+    for (int i = 1 ; i < CW_WIN_MAX ; i++)
+      cfg->window_s[i] = 0;
+    ret = 1;
+  }
+
+  if (cfg->dead_time_us == CONFIG_DT_INVALID)
+  {
+    cfg->dead_time_us = CONFIG_DT_DEFAULT;
+    ret = 1;
+  }
+
+  return ret;
 }
 
 /* initialize structure to all invalid */
@@ -112,6 +152,10 @@ void cfgSetInvalid(config_t *cfg)
   cfg->coord_truncation = CONFIG_CT_INVALID;
   cfg->hv_sense         = CONFIG_HV_INVALID;
   cfg->sd_rw            = CONFIG_SD_INVALID;
+  cfg->bin_s            = CONFIG_BS_INVALID;
+  for (int i = 0 ; i < CW_WIN_MAX ; i++)
+    cfg->window_s[i]    = CONFIG_WN_INVALID;
+  cfg->dead_time_us     = CONFIG_DT_INVALID;
 }
 
 /* copy src into dst */
@@ -145,6 +189,42 @@ int configFromFile(config_t *cfg)
       key = val = fline;
       key = strsep(&val, CONFIG_KEYVAL_SEP);
 
+      /* no separator, skip line */
+      if (val == NULL)
+        continue;
+
+      /* bins, windows and dead time are in decimal */
+      if (strcmp_P(key, DT_K) == 0)
+      {
+        char *endptr;
+        uint32_t v = (uint32_t)strtoul(val, &endptr, 10);
+
+        if (*endptr != '\0' || endptr == val || v >= CONFIG_DT_INVALID)
+          continue;
+        cfg->dead_time_us = (uint16_t)v;
+
+        n_param_found++;
+        continue;
+      }
+      else if (strcmp_P(key, BS_K) == 0 || strcmp_P(key, WN_K) == 0)
+      {
+        uint16_t win[CW_WIN_MAX];
+
+        if (!parseWindows(val, win))
+          continue;
+        if (strcmp_P(key, BS_K) == 0)
+        {
+          if (win[1] != 0 || win[0] > 0xFE)
+            continue;
+          cfg->bin_s = (uint8_t)win[0];
+        }
+        else
+          memcpy(cfg->window_s, win, sizeof(win));
+
+        n_param_found++;
+        continue;
+      }
+
       /* parse value */
       char *endptr;
       uint32_t v = (uint32_t)strtoul(val, &endptr, 16);
@@ -225,6 +305,21 @@ int configToFile()
   sprintf(val, "%u", (unsigned int)theConfig.sd_rw);
   writeKeyVal(&cfile, key, val);
 
+  /* write the length of the bins */
+  strcpy_P(key, BS_K);
+  sprintf(val, "%u", (unsigned int)theConfig.bin_s);
+  writeKeyVal(&cfile, key, val);
+
+  /* write the length of the windows */
+  strcpy_P(key, WN_K);
+  sprintWindows(val, theConfig.window_s);
+  writeKeyVal(&cfile, key, val);
+
+  /* write the dead time of the tube */
+  strcpy_P(key, DT_K);
+  sprintf(val, "%u", (unsigned int)theConfig.dead_time_us);
+  writeKeyVal(&cfile, key, val);
+
   /* close file */
   cfile.close();
 
@@ -304,3 +399,40 @@ void writeKeyVal(File *file, char *key, char *val)
   file->write('\n');
 }
 
+/* parse a list of window lengths in seconds, e.g. 60,5,600 */
+/* unused windows are set to 0, returns 0 when the list is not valid */
+int parseWindows(char *str, uint16_t *win)
+{
+  char *endptr;
+  int i;
+
+  for (i = 0 ; i < CW_WIN_MAX ; i++)
+    win[i] = 0;
+
+  for (i = 0 ; i < CW_WIN_MAX ; i++)
+  {
+    unsigned long v = strtoul(str, &endptr, 10);
+    if (endptr == str || v == 0 || v > 0xFFFE)
+      return 0;
+    win[i] = (uint16_t)v;
+
+    if (*endptr == '\0')
+      return 1;
+    if (*endptr != ',')
+      return 0;
+    str = endptr + 1;
+  }
+
+  /* too many windows */
+  return 0;
+}
+
+/* print a list of window lengths in seconds */
+void sprintWindows(char *buf, uint16_t *win)
+{
+  int i;
+
+  buf[0] = '\0';
+  for (i = 0 ; i < CW_WIN_MAX && win[i] != 0 ; i++)
+    sprintf(buf + strlen(buf), (i == 0) ? "%u" : ",%u", (unsigned int)win[i]);
+}
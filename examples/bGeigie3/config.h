@@ -14,12 +14,28 @@
 #include <stdlib.h>
 
 #include <SD.h>
+#include <CountWindows.h>
 
 // Enable or Disable features
 #define RADIO_ENABLE 1
 #define SD_READER_ENABLE 1
 #define BG_PWR_ENABLE 1
 #define CMD_LINE_ENABLE 1
+#define GPS_HIGH_RATE_ENABLE 0   // GPS at 10 Hz, records carry the mean position of the bin
+#define GPS_POWER_SAVE_ENABLE 1  // GPS in low power mode while the bGeigie does not move
+#define PULSE_HIST_ENABLE 0      // timestamps of the pulses, histogram of their intervals logged
+#define PULSE_HIST_PERIOD 600    // seconds between two histograms
+#define TUBE2_ENABLE 0           // second tube counted by Timer3, the serial port then only transmits
+
+// The second tube is on the serial receive pin, and Timer3 cannot time the pulses too
+// The TX line of the USB serial bridge must be disconnected from PD0: turning
+// the receiver off with RXEN0 does not stop the bridge from driving the pin.
+#if TUBE2_ENABLE && CMD_LINE_ENABLE
+#error "The second tube takes the serial receive pin, disable CMD_LINE_ENABLE"
+#endif
+#if TUBE2_ENABLE && PULSE_HIST_ENABLE
+#error "The second tube takes Timer3, disable PULSE_HIST_ENABLE"
+#endif
 
 /* Battery options */
 #define BATT_LOW_VOLTAGE 3700       // indicate battery low when this voltage is reached
@@ -41,11 +57,17 @@
 #define CONFIG_CT_INVALID 0xFF
 #define CONFIG_HV_INVALID 0xFF
 #define CONFIG_SD_INVALID 0xFF
+#define CONFIG_BS_INVALID 0xFF
+#define CONFIG_WN_INVALID 0xFFFF
+#define CONFIG_DT_INVALID 0xFFFF
 
 #define CONFIG_SO_DEFAULT 1
 #define CONFIG_CT_DEFAULT 0
 #define CONFIG_HV_DEFAULT 0
 #define CONFIG_SD_DEFAULT 0
+#define CONFIG_BS_DEFAULT 5     // 5 seconds bins
+#define CONFIG_WN_DEFAULT 60    // the CPM over one minute
+#define CONFIG_DT_DEFAULT 40    // dead time of the LND7317 in us, minimum of the datasheet
 
 #define CONFIG_MAGIC 0xBEEF
 
@@ -70,6 +92,13 @@ typedef struct
   uint8_t hv_sense;
   /* SD reader is read/write Enable (1) / Disable (0) */
   uint8_t sd_rw;
+  /* length of the count bins in seconds */
+  uint8_t bin_s;
+  /* length of the CPM windows in seconds, 0 when not used */
+  /* the first one is the CPM of the radiation data sentence */
+  uint16_t window_s[CW_WIN_MAX];
+  /* dead time of the tube in us, 0 for no correction */
+  uint16_t dead_time_us;
 } config_t;
 
 /* the configuration */
@@ -80,10 +109,13 @@ extern char PROGMEM SO_K[];
 extern char PROGMEM CT_K[];
 extern char PROGMEM HV_K[];
 extern char PROGMEM SD_K[];
+extern char PROGMEM BS_K[];
+extern char PROGMEM WN_K[];
+extern char PROGMEM DT_K[];
 
 /* all the function definitions */
 void config_init();
-void cfgSetDefault(config_t *cfg);
+int cfgSetDefault(config_t *cfg);
 void cfgSetInvalid(config_t *cfg);
 void cfgcpy(config_t *dst, config_t *src);
 int configFromFile(config_t *cfg);
@@ -96,5 +128,7 @@ void writeEEPROM(int addr, uint8_t *ptr, size_t len);
 /* helper functions */
 int readNextLine(File *file, char *buf, int max_len);
 void writeKeyVal(File *file, char *key, char *val);
+int parseWindows(char *str, uint16_t *win);
+void sprintWindows(char *buf, uint16_t *win);
 
 #endif /* __CONFIG_H__ */
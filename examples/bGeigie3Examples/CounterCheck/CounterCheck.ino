@@ -0,0 +1,204 @@
+/*
+   CounterCheck.ino
+   Check of the Hardware Counter library against a known pulse train
+
+   The high voltage stays off and the sketch makes the pulses itself: the
+   counter input is set as output and toggled from the Timer2 compare
+   interrupt, Timer1 counts the edges of its input pin all the same.
+   PULSE_N pulses at PULSE_HZ are counted in bins of BIN_MS, first stopping
+   and restarting the counter between bins with count() and start(), then
+   with the counter running free and next_bin(), and last with the bins
+   closed by the interrupt after schedule() and read by get_bin() from a
+   loop that is slower than the bins. The sum of the bins is compared to
+   the number of pulses sent, the free running counter must not lose any.
+   The bins closed by the interrupt must all be BIN_MS long, give or take
+   the few ms between two runs of the interrupt.
+
+   The snapshot is then checked across a Timer1 overflow: the timer is set
+   to 0xFFFF and one pulse makes it wrap while interrupts are off, so that
+   the overflow is pending and not yet counted by the interrupt. The
+   snapshots before the pulse, with the overflow pending and after the
+   interrupt ran must read 65535, 65536 and 65536.
+
+   This example is in the public domain.
+*/
+
+#include <HardwareCounter.h>
+#include <bg3_pins.h>
+#include <bg_sensors.h>
+#include <SD.h>
+#include <SPI.h>
+
+#define PULSE_HZ 10000     // pulse rate, Timer2 toggles the pin twice as fast
+#define PULSE_N  200000UL  // pulses sent for each mode
+#define BIN_MS   50        // length of the bins
+#define LOOP_MS  120       // time the loop takes with the scheduled bins
+
+static HardwareCounter counter(counts, BIN_MS);
+
+static volatile unsigned long pulses;  // pulses left to send
+static volatile byte level;            // level of the counter input
+
+void setup()
+{
+  Serial.begin(57600);
+  Serial.println("Counter check");
+
+  // the tube must not add pulses
+  bg_hvps_pwr_config();
+  bg_hvps_off();
+
+  check(0);
+  check(1);
+  check_scheduled();
+  check_overflow();
+}
+
+void loop()
+{
+}
+
+// Send PULSE_N pulses and count them in bins, free running or not
+void check(byte gapless)
+{
+  unsigned long sum = 0, bins = 0;
+
+  counter.start();
+  pinMode(counts, OUTPUT);
+  digitalWrite(counts, LOW);
+  level = 0;
+  pulses = PULSE_N;
+  pulse_start();
+
+  while (pulses > 0)
+  {
+    if (!counter.available())
+      continue;
+
+    if (gapless)
+    {
+      sum += counter.next_bin();
+    }
+    else
+    {
+      sum += counter.count();
+      counter.start();
+      pinMode(counts, OUTPUT);   // start() sets the pin as input
+    }
+    bins++;
+  }
+
+  // the last bin
+  delay(10);
+  if (gapless)
+    sum += counter.next_bin();
+  else
+    sum += counter.count();
+
+  Serial.print(gapless ? "next_bin(): " : "count() and start(): ");
+  Serial.print(bins);
+  Serial.print(" bins, ");
+  Serial.print(sum);
+  Serial.print(" counts, ");
+  Serial.print((long)(PULSE_N - sum));
+  Serial.println(" lost");
+}
+
+// Send PULSE_N pulses, the bins are closed by the interrupt
+void check_scheduled()
+{
+  unsigned long sum = 0, bins = 0, wrong = 0;
+  byte last = 2;
+  bin_t bin;
+
+  counter.start();
+  counter.schedule();
+  pinMode(counts, OUTPUT);
+  digitalWrite(counts, LOW);
+  level = 0;
+  pulses = PULSE_N;
+  pulse_start();
+
+  // two more passes after the pulses stop for the last bin
+  while (last > 0)
+  {
+    if (pulses == 0)
+      last--;
+
+    // a slow loop, several bins are queued in the meantime
+    delay(LOOP_MS);
+    while (counter.get_bin(&bin))
+    {
+      sum += bin.count;
+      if (abs((long)(bin.end - bin.start) - BIN_MS) > 3)
+        wrong++;
+      bins++;
+    }
+  }
+
+  Serial.print("schedule(): ");
+  Serial.print(bins);
+  Serial.print(" bins, ");
+  Serial.print(wrong);
+  Serial.print(" of wrong length, ");
+  Serial.print(sum);
+  Serial.print(" counts, ");
+  Serial.print((long)(PULSE_N - sum));
+  Serial.println(" lost");
+}
+
+// Snapshots across an overflow not yet serviced by the interrupt
+void check_overflow()
+{
+  unsigned long before, pending, after;
+
+  counter.start();
+  pinMode(counts, OUTPUT);
+  digitalWrite(counts, LOW);
+
+  cli();
+  TCNT1 = 0xFFFF;
+  before = counter.snapshot();
+  digitalWrite(counts, HIGH);   // one pulse, Timer1 wraps to 0
+  delayMicroseconds(2);         // the input is synchronized to the clock
+  pending = counter.snapshot();
+  sei();
+  after = counter.snapshot();
+  digitalWrite(counts, LOW);
+
+  Serial.print("overflow: ");
+  Serial.print(before);
+  Serial.print(", ");
+  Serial.print(pending);
+  Serial.print(", ");
+  Serial.print(after);
+  Serial.println((before == 65535 && pending == 65536 && after == 65536) ? " ok" : " FAILED");
+}
+
+// Toggle the counter input from the Timer2 compare A interrupt
+void pulse_start()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  TCCR2A = _BV(WGM21);              // CTC mode
+  TCCR2B = _BV(CS21);               // clock / 8
+  TCNT2 = 0;
+  OCR2A = F_CPU / 8 / (2 * PULSE_HZ) - 1;
+  TIMSK2 |= _BV(OCIE2A);
+  SREG = oldSREG;
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+  if (pulses == 0)
+  {
+    TIMSK2 &= ~_BV(OCIE2A);
+    return;
+  }
+
+  // a pulse is counted on its rising edge
+  level ^= 1;
+  digitalWrite(counts, level);
+  if (level == 0)
+    pulses--;
+}
@@ -0,0 +1,139 @@
+/*
+   GPSBench.ino
+   Timing of the GPS library NMEA parser
+
+   This example replays a typical MTK output epoch (GGA, GSA, GSV, RMC, VTG)
+   through the streaming parser of the GPS library, and through the old
+   line-based parser (strlen, checksum verification, strsep, strcmp) kept
+   below for reference. The average number of CPU cycles per sentence is
+   printed for both. No GPS module is needed.
+
+   This example is in the public domain.
+*/
+
+#include <SD.h>
+#include <SPI.h>
+
+#include <bg3_pins.h>
+#include <GPS.h>
+
+#define N_RUNS 100
+#define N_SENTENCES 5
+
+// One epoch of MTK output
+const char s_gga[] PROGMEM = "$GPGGA,175836.000,4618.9424,N,00658.4802,E,1,08,1.27,428.1,M,48.0,M,,*68\r\n";
+const char s_gsa[] PROGMEM = "$GPGSA,A,3,10,07,05,02,29,04,08,13,,,,,1.72,1.27,1.16*00\r\n";
+const char s_gsv[] PROGMEM = "$GPGSV,3,1,12,10,63,137,17,07,61,098,15,05,59,290,20,08,54,157,30*73\r\n";
+const char s_rmc[] PROGMEM = "$GPRMC,175836.000,A,4618.9424,N,00658.4802,E,0.02,31.66,161212,,,A*52\r\n";
+const char s_vtg[] PROGMEM = "$GPVTG,31.66,T,,M,0.02,N,0.04,K,A*09\r\n";
+const char *epoch[N_SENTENCES] = { s_gga, s_gsa, s_gsv, s_rmc, s_vtg };
+
+// the line buffer for the GPS library
+static char line[LINE_SZ];
+
+// buffers for the reference parser
+static char ref_line[LINE_SZ];
+static gps_t ref_data;
+
+void setup()
+{
+  char buf[LINE_SZ];
+  unsigned long t0, t_new, t_old;
+  int i, n, k;
+
+  Serial.begin(57600);
+  Serial.println("GPS parser benchmark");
+
+  // The GPS serial port is not read, all data comes from flash
+  gps_init(&Serial1, line);
+
+  for (n = 0 ; n < N_SENTENCES ; n++)
+  {
+    strcpy_P(buf, epoch[n]);
+
+    // streaming parser, one character at a time
+    t0 = micros();
+    for (i = 0 ; i < N_RUNS ; i++)
+      for (k = 0 ; buf[k] != '\0' ; k++)
+        gps_encode(buf[k]);
+    t_new = micros() - t0;
+
+    // reference parser, on the complete line
+    t0 = micros();
+    for (i = 0 ; i < N_RUNS ; i++)
+    {
+      for (k = 0 ; buf[k] != '\0' ; k++)
+        ref_line[k] = buf[k];
+      ref_line[k] = '\0';
+      ref_parse_line();
+    }
+    t_old = micros() - t0;
+
+    buf[6] = '\0';
+    Serial.print(buf);
+    Serial.print(" cycles/sentence, before ");
+    Serial.print(t_old * (F_CPU / 1000000L) / N_RUNS);
+    Serial.print(", after ");
+    Serial.println(t_new * (F_CPU / 1000000L) / N_RUNS);
+  }
+
+  Serial.print("Parsed position ");
+  Serial.print(gps_getData()->lat);
+  Serial.print(gps_getData()->lat_hem);
+  Serial.print(' ');
+  Serial.print(gps_getData()->lon);
+  Serial.println(gps_getData()->lon_hem);
+}
+
+void loop()
+{
+}
+
+// The line based parser the library used before the streaming parser
+void ref_parse_line()
+{
+  char *tok[SYM_SZ] = {0};
+  char *string;
+  int j = 0;
+
+  int L = strlen(ref_line);
+  if (!gps_verify_NMEA_sentence(ref_line, L-2)) // -2 is for \r\n
+    return;
+
+  string = ref_line;
+  while (j < SYM_SZ && (tok[j++] = strsep(&string, ",")) != NULL)
+    ;
+
+  if (strcmp(tok[0], "$GPRMC") == 0)
+  {
+    memset(&ref_data.utc, 0, UTC_SZ-1);
+    memset(&ref_data.status, 0, DEFAULT_SZ-1);
+    memset(&ref_data.lat, 0, LAT_SZ-1);
+    memset(&ref_data.lat_hem, 0, DEFAULT_SZ-1);
+    memset(&ref_data.lon, 0, LON_SZ-1);
+    memset(&ref_data.lon_hem, 0, DEFAULT_SZ-1);
+    memset(&ref_data.speed, 0, SPD_SZ-1);
+    memset(&ref_data.course, 0, CRS_SZ-1);
+    memset(&ref_data.date, 0, DATE_SZ-1);
+    memcpy(&ref_data.utc, tok[1], UTC_SZ-1);
+    memcpy(&ref_data.status, tok[2], DEFAULT_SZ-1);
+    memcpy(&ref_data.lat, tok[3], LAT_SZ-1);
+    memcpy(&ref_data.lat_hem, tok[4], DEFAULT_SZ-1);
+    memcpy(&ref_data.lon, tok[5], LON_SZ-1);
+    memcpy(&ref_data.lon_hem, tok[6], DEFAULT_SZ-1);
+    memcpy(&ref_data.speed, tok[7], SPD_SZ-1);
+    memcpy(&ref_data.course, tok[8], CRS_SZ-1);
+    memcpy(&ref_data.date, tok[9], DATE_SZ-1);
+  }
+  else if (strcmp(tok[0], "$GPGGA") == 0)
+  {
+    memset(&ref_data.quality, 0, DEFAULT_SZ-1);
+    memset(&ref_data.num_sat, 0, NUM_SAT_SZ-1);
+    memset(&ref_data.precision, 0, PRECISION_SZ-1);
+    memset(&ref_data.altitude, 0, ALTITUDE_SZ-1);
+    memcpy(&ref_data.quality, tok[6], DEFAULT_SZ-1);
+    memcpy(&ref_data.num_sat, tok[7], NUM_SAT_SZ-1);
+    memcpy(&ref_data.precision, tok[8], PRECISION_SZ-1);
+    memcpy(&ref_data.altitude, tok[9], ALTITUDE_SZ-1);
+  }
+}
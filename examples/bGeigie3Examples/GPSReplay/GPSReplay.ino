@@ -0,0 +1,170 @@
+/*
+   GPSReplay.ino
+   Replay of a GPS capture through the GPS library parser
+
+   This example reads a capture file from the SD card and feeds it to the
+   streaming parser of the GPS library, REPLAY_CHUNK bytes at a time and
+   paced to arrive at REPLAY_BAUD. The capture can be the raw output of the
+   module saved from GPSDump, or a bGeigie log file whose $BNXRDD lines are
+   received and skipped like any other unknown sentence.
+
+   At the end of the file, the number of lines, parsed sentences and
+   errors is printed along with the parser throughput (lines per second of
+   CPU time), the bytes fed per line, and the share of CPU time the parser
+   needs at the replay rate. The valid fixes of the capture are counted
+   with the result of the fix quality filter, accepted, rejected or held,
+   and the distance of the track is given with and without the filter.
+   No GPS module is needed.
+
+   This example is in the public domain.
+*/
+
+#include <SD.h>
+#include <SPI.h>
+
+#include <bg3_pins.h>
+#include <GPS.h>
+#include <sd_logger.h>
+
+#define REPLAY_FILE "GPSDUMP.TXT"  // capture on the SD card
+#define REPLAY_BAUD 9600           // rate of the bytes fed to the parser, 0 for full speed
+#define REPLAY_CHUNK 16            // bytes fed to the parser at once, at most 64
+
+// the line buffer for the GPS library
+static char line[LINE_SZ];
+
+void setup()
+{
+  byte buf[REPLAY_CHUNK];
+  unsigned long bytes = 0, lines = 0, parsed = 0;
+  unsigned long t_parse = 0, t_start, t0;
+  unsigned long fixes = 0, rejected = 0, held = 0;
+  float dist_all = 0, dist_flt = 0;
+  gps_fix_t last_all, last_flt;
+  unsigned int seq = 0;
+  gps_stats_t stats;
+  char name[20];
+  File f;
+  int i, n;
+
+  Serial.begin(57600);
+  Serial.println("GPS replay");
+
+  // the SD card and radio share the SPI bus
+  pinMode(SS, OUTPUT);
+  digitalWrite(SS, HIGH);
+  pinMode(cs_radio, OUTPUT);
+  digitalWrite(cs_radio, HIGH);
+
+  if (!sd_log_init(sd_pwr, sd_detect, cs_sd))
+  {
+    Serial.println("SD card not found");
+    return;
+  }
+
+  strcpy_P(name, PSTR(REPLAY_FILE));
+  f = SD.open(name, FILE_READ);
+  if (!f)
+  {
+    Serial.print("Cannot open ");
+    Serial.println(name);
+    return;
+  }
+
+  // The GPS serial port is not read, all data comes from the file
+  gps_init(&Serial1, line);
+
+  t_start = micros();
+  while ((n = f.read(buf, REPLAY_CHUNK)) > 0)
+  {
+#if REPLAY_BAUD > 0
+    // wait for the chunk to be received, 10 bits per byte
+    while (micros() - t_start < (bytes + n) * (10000000UL / REPLAY_BAUD))
+      ;
+#endif
+
+    t0 = micros();
+    for (i = 0 ; i < n ; i++)
+    {
+      if (buf[i] == '\n')
+        lines++;
+      parsed += gps_encode(buf[i]);
+    }
+    t_parse += micros() - t0;
+
+    // a new epoch was published
+    if (gps_seq() != seq)
+    {
+      gps_fix_t *fix = gps_getFix();
+      seq = gps_seq();
+      if (fix->status & GPS_FIX_VALID)
+      {
+        if (fixes++ > 0)
+          dist_all += distance(&last_all, fix);
+        last_all = *fix;
+
+        if (fix->status & GPS_FIX_REJECTED)
+          rejected++;
+        else if (fix->status & GPS_FIX_HELD)
+          held++;
+        else
+        {
+          if (fixes - rejected - held > 1)
+            dist_flt += distance(&last_flt, fix);
+          last_flt = *fix;
+        }
+      }
+    }
+
+    bytes += n;
+  }
+  t_start = micros() - t_start;
+  f.close();
+
+  gps_get_stats(&stats);
+
+  Serial.print("Bytes ");
+  Serial.println(bytes);
+  Serial.print("Lines ");
+  Serial.println(lines);
+  Serial.print("Sentences parsed ");
+  Serial.println(parsed);
+  Serial.print("Checksum errors ");
+  Serial.println(stats.chk_errors);
+  Serial.print("Lines truncated ");
+  Serial.println(stats.truncated);
+  Serial.print("Valid fixes ");
+  Serial.println(fixes);
+  Serial.print("Fixes rejected ");
+  Serial.println(rejected);
+  Serial.print("Fixes held ");
+  Serial.println(held);
+  Serial.print("Track length m, all fixes ");
+  Serial.println(dist_all);
+  Serial.print("Track length m, accepted fixes ");
+  Serial.println(dist_flt);
+
+  if (lines == 0 || t_parse == 0)
+    return;
+
+  Serial.print("Lines per second of CPU ");
+  Serial.println(lines * 1000000.0 / t_parse);
+  Serial.print("Bytes per line ");
+  Serial.println((float)bytes / lines);
+  Serial.print("Cycles per byte ");
+  Serial.println(t_parse * (F_CPU / 1000000L) / bytes);
+  Serial.print("CPU load % ");
+  Serial.println(100.0 * t_parse / t_start);
+}
+
+void loop()
+{
+}
+
+// Distance in meters between two fixes
+float distance(gps_fix_t *a, gps_fix_t *b)
+{
+  float dy = (b->lat - a->lat) * 0.111195;  // microdegrees to meters
+  float dx = (b->lon - a->lon) * 0.111195 * cos(b->lat * (M_PI / 180e6));
+  return sqrt(dx * dx + dy * dy);
+}
@@ -48,7 +48,7 @@ void loop()
   // if counter result available
   if (counter.available())
   {
-    int cpb = counter.count();    // fetch value of counter
+    int cpb = counter.next_bin(); // fetch value of counter, keeps counting
     int i;
     int cpm = 0;
     bins[index] = cpb;
@@ -64,9 +64,6 @@ void loop()
     Serial.print(" (HV == ");
     Serial.print(bgs_read_hv());
     Serial.println(")");
-
-    // restart the counter
-    counter.start();
   }
 }
 
@@ -973,16 +973,29 @@ void gps_program_settings()
   // all GPS command taken from datasheet
   // "Binary Messages Of SkyTraq Venus 6 GPS Receiver"
 
+#if GPS_SKYTRAQ_ENABLE
+  // set binary output, the library parses the navigation data message
+  uint8_t GPS_MSG_OUTPUT_BINARY[3] = { STQ_MSG_TYPE, 0x02, 0x01 }; // with update to RAM and FLASH
+  uint16_t GPS_MSG_OUTPUT_BINARY_L = 3;
+#else
   // set GGA and RMC output at 1Hz
   uint8_t GPS_MSG_OUTPUT_GGARMC_1S[9] = { 0x08, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01 }; // with update to RAM and FLASH
   uint16_t GPS_MSG_OUTPUT_GGARMC_1S_L = 9;
+#endif
 
   // Power Save mode (not sure what it is doing at the moment
   uint8_t GPS_MSG_PWR_SAVE[3] = { 0x0C, 0x01, 0x01 }; // update to FLASH too
   uint16_t GPS_MSG_PWR_SAVE_L = 3;
 
+  // the library sends the binary messages on the GPS port
+  gps_init(&Serial, line);
+
   // send all commands
+#if GPS_SKYTRAQ_ENABLE
+  gps_send_message(GPS_MSG_OUTPUT_BINARY, GPS_MSG_OUTPUT_BINARY_L);
+#else
   gps_send_message(GPS_MSG_OUTPUT_GGARMC_1S, GPS_MSG_OUTPUT_GGARMC_1S_L);
+#endif
   gps_send_message(GPS_MSG_PWR_SAVE, GPS_MSG_PWR_SAVE_L);
 
 #elif GPS_TYPE == GPS_MTK
@@ -999,49 +1012,3 @@ void gps_program_settings()
 }
 #endif /* GPS_PROGAMMING */
 
-#if GPS_PROGRAMMING && GPS_TYPE == GPS_CANMORE
-void gps_send_message(const uint8_t *msg, uint16_t len)
-{
-  uint8_t chk = 0x0;
-
-#if ARDUINO < 100
-  // header
-  Serial.print(0xA0, BYTE);
-  Serial.print(0xA1, BYTE);
-  // send length
-  Serial.print(len >> 8, BYTE);
-  Serial.print(len & 0xff, BYTE);
-  // send message
-  for (int i = 0 ; i < len ; i++)
-  {
-    Serial.print(msg[i], BYTE);
-    chk ^= msg[i];
-  }
-  // checksum
-  Serial.print(chk, BYTE);
-  // end of message
-  Serial.print(0x0D, BYTE);
-  Serial.println(0x0A, BYTE);
-#else
-  // header
-  Serial.write(0xA0);
-  Serial.write(0xA1);
-  // send length
-  Serial.write(len >> 8);
-  Serial.write(len & 0xff);
-  // send message
-  for (int i = 0 ; i < len ; i++)
-  {
-    Serial.write(msg[i]);
-    chk ^= msg[i];
-  }
-  // checksum
-  Serial.write(chk);
-  // end of message
-  Serial.write(0x0D);
-  Serial.write(0x0A);
-  Serial.write((byte)'\r');
-  Serial.write((byte)'\n');
-#endif
-}
-#endif /* GPS_CANMORE */
@@ -40,6 +40,9 @@
 /* device id length */
 #define BMRDD_ID_LEN 3
 
+#define MAX_PKT_SIZE 127
+#define RX_LINE_SZ 200
+
 #define DIM_TIME 60000
 #define DIM_LEN 1000
 
@@ -70,6 +73,11 @@ char gps_flag = 'A';
 char data_corrupt_flag = 0;
 char dev_id[BMRDD_ID_LEN+1];  // device id
 
+// a sentence longer than a radio frame comes in several frames
+static char rx_line[RX_LINE_SZ+1];
+static int rx_len = 0;
+static uint16_t rx_src;
+
 // diagnostic variables
 int temperature = -1;
 int humidity = -1;
@@ -163,24 +171,65 @@ void loop()
   if (chibiDataRcvd() == true)
   { 
     int L; //, rssi, src_addr;
-    byte buf[150] = {0};  // this is where we store the received data
+    byte buf[MAX_PKT_SIZE+1] = {0};  // this is where we store the received data
     char line[9] = {0};
     int pos_dollar, pos_star;
+    uint16_t src;
+    byte wait_frame = 0;
 
     // retrieve the data
     L = chibiGetData(buf);
+    src = chibiGetSrcAddr();
+
+    // check the size of the data received to avoid buffer overflow
+    if (L > MAX_PKT_SIZE)
+      buf[MAX_PKT_SIZE] = 0; // null terminate at max length
+    else
+      buf[L] = 0; // null terminate the string.
+
+    // older devices pad the frame with zeros
+    L = strlen((char *)buf);
 
-    // find the beginning and end of expected sentence
+    // find the beginning of expected sentence. A frame without one is
+    // the rest of the sentence of the last frame of the same device.
     pos_dollar = find_char((char *)buf, '$', L);
-    pos_star   = find_char((char *)buf, '*', L);
+    if (pos_dollar != -1)
+    {
+      rx_len = 0;
+      rx_src = src;
+    }
+    else if (rx_len > 0 && src == rx_src)
+      pos_dollar = 0;
 
-    if (pos_dollar != -1 && pos_star != -1)
+    if (pos_dollar != -1 && rx_len + L - pos_dollar <= RX_LINE_SZ)
+    {
+      memcpy(rx_line + rx_len, buf + pos_dollar, L - pos_dollar);
+      rx_len += L - pos_dollar;
+      rx_line[rx_len] = 0;
+    }
+    else
+    {
+      pos_dollar = -1;
+      rx_len = 0;
+    }
+
+    // find the end of expected sentence
+    pos_star = find_char(rx_line, '*', rx_len);
+
+    if (pos_dollar != -1 && (pos_star == -1 || rx_len < pos_star+3))
+    {
+      // wait for the next frame
+      data_corrupt_flag = 0;
+      wait_frame = 1;
+    }
+    else if (pos_dollar != -1)
     {
       // make sure it's a null terminated string
-      buf[pos_star+3] = 0;
+      rx_line[pos_star+3] = 0;
+      rx_len = 0;
       
       // Print out the message
-      Serial.println((char *)buf);
+      Serial.println(rx_line);
      
       // set time of message received
       last_msg_time = millis();
@@ -189,7 +238,7 @@ void loop()
       lnk_flag = 'O';
 
       // extract the data from the sentence received
-      extract_data((char *)(buf+pos_dollar), pos_star-pos_dollar+3);
+      extract_data(rx_line, pos_star+3);
     }
     else
     {
@@ -211,7 +260,7 @@ void loop()
       // lcd.print("Received");
       Serial.println("Data was corrupted.");
     }
-    else
+    else if (!wait_frame)
     { // If data received is not corrupted (checksum matches)
 
       // compute dose rate
@@ -32,6 +32,7 @@ typedef struct
   uint16_t uSh_dec;
   char rad_flag;
   char gps_flag;
+  uint8_t rad_alarm;      // the bGeigie3 sees a significant increase of the counts
   int num_sat;
 
   // diagnostic variables
@@ -49,6 +49,7 @@
 #define BMRDD_ID_LEN 3
 
 #define MAX_PKT_SIZE 127
+#define RX_LINE_SZ 200
 
 #define DIM_TIME 60000
 #define DIM_LEN 1000
@@ -62,6 +63,11 @@
 // a buffer line for the oled display
 static char strbuffer[STRBUFFER_SZ];
 
+// a sentence longer than a radio frame comes in several frames
+static char rx_line[RX_LINE_SZ+1];
+static int rx_len = 0;
+static uint16_t rx_src;
+
 // initialize the library with the numbers of the interface pins
 int OLED_PWR    = 5;
 int OLED_CLK    = 12;
@@ -167,9 +173,11 @@ void loop()
     byte buf[MAX_PKT_SIZE+1] = {0};  // this is where we store the received data
     char line[9] = {0};
     int pos_dollar, pos_star;
+    uint16_t src;
 
     // retrieve the data
     L = chibiGetData(buf);
+    src = chibiGetSrcAddr();
 
     // check the size of the data received to avoid buffer overflow
     if (L > MAX_PKT_SIZE)
@@ -177,24 +185,53 @@ void loop()
     else
       buf[L] = 0; // null terminate the string.
 
-    // find the beginning and end of expected sentence
+    // older devices pad the frame with zeros
+    L = strlen((char *)buf);
+
+    // find the beginning of expected sentence. A frame without one is
+    // the rest of the sentence of the last frame of the same device.
     pos_dollar = find_char((char *)buf, '$', L);
-    pos_star   = find_char((char *)buf, '*', L);
+    if (pos_dollar != -1)
+    {
+      rx_len = 0;
+      rx_src = src;
+    }
+    else if (rx_len > 0 && src == rx_src)
+      pos_dollar = 0;
+
+    if (pos_dollar != -1 && rx_len + L - pos_dollar <= RX_LINE_SZ)
+    {
+      memcpy(rx_line + rx_len, buf + pos_dollar, L - pos_dollar);
+      rx_len += L - pos_dollar;
+      rx_line[rx_len] = 0;
+    }
+    else
+    {
+      pos_dollar = -1;
+      rx_len = 0;
+    }
+
+    // find the end of expected sentence
+    pos_star = find_char(rx_line, '*', rx_len);
 
-    if (pos_dollar != -1 && pos_star != -1)
+    if (pos_dollar != -1 && (pos_star == -1 || rx_len < pos_star+3))
+    {
+      // wait for the next frame
+      data_corrupt_flag = 0;
+    }
+    else if (pos_dollar != -1)
     {
       // make sure it's a null terminated string
-      buf[pos_star+3] = 0;
-      buf[pos_star+4] = 0;
-      buf[pos_star+5] = 0;
+      rx_line[pos_star+3] = 0;
+      rx_len = 0;
       
       // Print out the message
-      Serial.println((char *)buf);
+      Serial.println(rx_line);
      
       // extract the data from the sentence received
       digitalWrite(led, HIGH);
       delay(50);
-      extract_data((char *)(buf+pos_dollar), pos_star-pos_dollar+3);
+      extract_data(rx_line, pos_star+3);
       digitalWrite(led, LOW);
     }
     else
@@ -296,8 +333,15 @@ void loop()
       display.println("No GPS");
     }
 
-    // print a message when radiation not ready
-    if (devices[d].rad_flag != 'A')
+    // print the alarm, or a message when radiation not ready
+    if (devices[d].rad_alarm)
+    {
+      display.setCursor(86, offset+16);
+      display.setTextSize(1);
+      display.setTextColor(BLACK, WHITE); // 'inverted' text
+      display.println("ALARM");
+    }
+    else if (devices[d].rad_flag != 'A')
     {
       display.setCursor(86, offset+16);
       display.setTextSize(1);
@@ -505,6 +549,7 @@ void init_device(int d, uint16_t id)
   devices[d].uSh_dec = 0;
   devices[d].rad_flag = 'V';
   devices[d].gps_flag = 'V';
+  devices[d].rad_alarm = 0;
   devices[d].num_sat = 0;
 
   // diagnostic variables
@@ -652,9 +697,15 @@ void extract_data(char *buf, int L)
       else
         devices[d].total = 0;
 
+      // the CPM corrected for the dead time of the tube, from the bGeigie3
+      // the conversion to uSv/h is linear in the true count rate only
+      unsigned long cpm_dt = devices[d].CPM;
+      if (obj_num >= 18 && strcmp_P(tok[0], PSTR("$BNXRDD")) == 0 && tok[16][0] != 0)
+        cpm_dt = strtoul(tok[16], NULL, 10);
+
       // save uSv/h value (AVOID USING FLOAT TO SAVE SPACE ON FLASH)
-      devices[d].uSh_int = devices[d].CPM/LND7313_CONVERSION_FACTOR;
-      devices[d].uSh_dec = ((devices[d].CPM*1000)/LND7313_CONVERSION_FACTOR) 
+      devices[d].uSh_int = cpm_dt/LND7313_CONVERSION_FACTOR;
+      devices[d].uSh_dec = ((cpm_dt*1000)/LND7313_CONVERSION_FACTOR) 
                             - devices[d].uSh_int*LND7313_CONVERSION_FACTOR;
 
 
@@ -672,6 +723,17 @@ void extract_data(char *buf, int L)
         buzz(4500, 1, 50, 0);
       devices[d].gps_flag = g_flag;
 
+      // the alarm of the bGeigie3, a few bins after the counts go up
+      // instead of the minute of the CPM
+      uint8_t alarm = 0;
+      if (obj_num >= 20 && strcmp_P(tok[0], PSTR("$BNXRDD")) == 0)
+        alarm = (tok[18][0] == '1');
+
+      /* buzz when the alarm starts */
+      if (!devices[d].rad_alarm && alarm)
+        buzz(3000, 3, 200, 100);
+      devices[d].rad_alarm = alarm;
+
     }
     else if (obj_num >= 14 && strcmp(tok[0], "$BNXSTS") == 0)
     {
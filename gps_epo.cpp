@@ -0,0 +1,274 @@
+/*
+   Upload of MTK EPO assistance data from the SD card to the GPS module
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+   The EPO file holds the predicted orbits of the GPS satellites as 60 byte
+   records. At power up, the GPS is switched to MTK binary mode and the
+   records are sent three at a time in packets of type 722, each one
+   acknowledged by the GPS. A final packet with sequence number 0xFFFF
+   ends the upload and the GPS is switched back to NMEA.
+
+   Everything runs from gps_epo_update() so that the main loop is never
+   blocked. Packets are written to the serial port a few bytes at a time,
+   no faster than the baud rate, so that the transmit buffer never fills.
+*/
+
+#include <SD.h>
+#include "GPS.h"
+#include "gps_epo.h"
+
+/* states of the upload */
+#define GPS_EPO_ST_IDLE   0   // nothing to do
+#define GPS_EPO_ST_WAIT   1   // waiting for GPS start and command queue
+#define GPS_EPO_ST_BINARY 2   // switching GPS to binary mode
+#define GPS_EPO_ST_SEND   3   // writing packet to the GPS
+#define GPS_EPO_ST_ACK    4   // waiting for the ACK of the packet
+#define GPS_EPO_ST_NMEA   5   // switching GPS back to NMEA mode
+
+/* 'private' methods declarations */
+void gps_epo_packet();              // read next packet from the file
+void gps_epo_frame(unsigned int cmd, byte len);  // add binary frame around payload
+byte gps_epo_send_chunk();          // write the next bytes of the packet
+void gps_epo_finish(byte status);   // close file and go back to NMEA
+
+/* state variables */
+File _epo_file;                     // the EPO file
+byte _epo_pkt[GPS_EPO_PKT_SZ];      // packet being sent
+byte _epo_pkt_len;                  // size of the packet
+byte _epo_sent;                     // bytes of the packet already sent
+byte _epo_state;                    // state of the upload
+byte _epo_status;                   // GPS_EPO_* status
+byte _epo_tries;                    // number of times the packet was sent
+unsigned int _epo_seq;              // sequence number of the packet
+unsigned int _epo_records;          // number of satellite records sent
+unsigned long _epo_time;            // time of last state change
+unsigned long _epo_tx_time;         // time of last write to the GPS
+unsigned long _epo_chunk_ms;        // time to transmit a chunk at the baud rate
+
+// Open the EPO file and schedule the upload
+// baud is the current baud rate of the GPS serial port
+// returns 1 if the upload was scheduled, 0 otherwise
+int gps_epo_start(char *filename, unsigned long baud)
+{
+  gps_epo_stop();
+  _epo_status = GPS_EPO_NONE;
+
+  if (!SD.exists(filename))
+    return 0;
+
+  _epo_file = SD.open(filename, FILE_READ);
+  if (!_epo_file)
+    return 0;
+
+  // the file must be made of complete satellite records
+  if (_epo_file.size() == 0 || _epo_file.size() % GPS_EPO_SV_SZ != 0)
+  {
+    _epo_file.close();
+    _epo_status = GPS_EPO_FAILED;
+    return 0;
+  }
+
+  _epo_seq = 0;
+  _epo_records = 0;
+  _epo_chunk_ms = GPS_EPO_CHUNK * 10000UL / baud + 1;  // 10 bits per byte
+  _epo_time = millis();
+  _epo_state = GPS_EPO_ST_WAIT;
+  _epo_status = GPS_EPO_BUSY;
+
+  return 1;
+}
+
+// Upload state machine
+void gps_epo_update()
+{
+  unsigned int cmd, id;
+  int ack;
+
+  switch (_epo_state)
+  {
+    case GPS_EPO_ST_WAIT:
+      // let the GPS start and finish its setup commands
+      if (millis() - _epo_time < GPS_EPO_DELAY || gps_command_pending())
+        break;
+      gps_command(PSTR(MTK_SET_BINARY));
+      _epo_state = GPS_EPO_ST_BINARY;
+      break;
+
+    case GPS_EPO_ST_BINARY:
+      // the switch to binary mode is done once the command is sent
+      if (gps_command_pending())
+        break;
+      _epo_tries = 0;
+      gps_epo_packet();
+      _epo_state = GPS_EPO_ST_SEND;
+      break;
+
+    case GPS_EPO_ST_SEND:
+      if (!gps_epo_send_chunk())
+        break;
+      _epo_tries++;
+      _epo_time = millis();
+      _epo_state = GPS_EPO_ST_ACK;
+      break;
+
+    case GPS_EPO_ST_ACK:
+      ack = gps_mtk_bin_ack(&cmd, &id);
+      if (ack == 1 && cmd == MTK_BIN_ACK_EPO && id == _epo_seq)
+      {
+        if (_epo_seq == GPS_EPO_SEQ_END)
+        {
+          gps_epo_finish(GPS_EPO_DONE);
+          break;
+        }
+        _epo_seq++;
+        _epo_tries = 0;
+        gps_epo_packet();
+        _epo_state = GPS_EPO_ST_SEND;
+        break;
+      }
+
+      // resend the packet when it was rejected or not acknowledged in time
+      if (ack != 0 && millis() - _epo_time < GPS_EPO_TIMEOUT)
+        break;
+      if (_epo_tries < GPS_EPO_RETRY)
+      {
+        _epo_sent = 0;
+        _epo_state = GPS_EPO_ST_SEND;
+      }
+      else
+      {
+        gps_epo_finish(GPS_EPO_FAILED);
+      }
+      break;
+
+    case GPS_EPO_ST_NMEA:
+      if (gps_epo_send_chunk())
+        _epo_state = GPS_EPO_ST_IDLE;
+      break;
+  }
+}
+
+// Abort the upload and close the file
+// The GPS is left in binary mode, it is meant to be turned off.
+void gps_epo_stop()
+{
+  if (_epo_state != GPS_EPO_ST_IDLE && _epo_state != GPS_EPO_ST_NMEA)
+  {
+    _epo_file.close();
+    if (_epo_status == GPS_EPO_BUSY)
+      _epo_status = GPS_EPO_FAILED;
+  }
+  _epo_state = GPS_EPO_ST_IDLE;
+}
+
+byte gps_epo_status()
+{
+  return _epo_status;
+}
+
+unsigned int gps_epo_records()
+{
+  return _epo_records;
+}
+
+// Read the next three satellite records into a new packet
+// The end of the file gives the final packet, with no records.
+void gps_epo_packet()
+{
+  byte *p = _epo_pkt + 6;  // payload after preamble, length and command
+  int n;
+
+  memset(p, 0, GPS_EPO_PAYLOAD_SZ);
+
+  n = _epo_file.read(p + 2, GPS_EPO_SV_PER_PKT*GPS_EPO_SV_SZ);
+  if (n <= 0)
+    _epo_seq = GPS_EPO_SEQ_END;
+  else
+    _epo_records += n / GPS_EPO_SV_SZ;
+
+  p[0] = _epo_seq & 0xFF;
+  p[1] = _epo_seq >> 8;
+
+  gps_epo_frame(MTK_BIN_EPO, GPS_EPO_PAYLOAD_SZ);
+}
+
+// Complete the binary frame around a payload of len bytes
+void gps_epo_frame(unsigned int cmd, byte len)
+{
+  byte i, chk = 0;
+
+  _epo_pkt_len = len + 2 + MTK_BIN_OVERHEAD;
+
+  _epo_pkt[0] = MTK_BIN_PREAMBLE0;
+  _epo_pkt[1] = MTK_BIN_PREAMBLE1;
+  _epo_pkt[2] = _epo_pkt_len;
+  _epo_pkt[3] = 0;
+  _epo_pkt[4] = cmd & 0xFF;
+  _epo_pkt[5] = cmd >> 8;
+
+  // checksum is the XOR of length, command and payload
+  for (i = 2 ; i < _epo_pkt_len - 3 ; i++)
+    chk ^= _epo_pkt[i];
+  _epo_pkt[i++] = chk;
+  _epo_pkt[i++] = '\r';
+  _epo_pkt[i] = '\n';
+
+  _epo_sent = 0;
+}
+
+// Write the next chunk of the packet, if enough time passed since the last one
+// returns 1 when the whole packet is sent
+byte gps_epo_send_chunk()
+{
+  unsigned long now = millis();
+  byte n;
+
+  if (_epo_sent > 0 && now - _epo_tx_time < _epo_chunk_ms)
+    return 0;
+
+  n = _epo_pkt_len - _epo_sent;
+  if (n > GPS_EPO_CHUNK)
+    n = GPS_EPO_CHUNK;
+  gps_send_bytes(_epo_pkt + _epo_sent, n);
+  _epo_sent += n;
+  _epo_tx_time = now;
+
+  return (_epo_sent == _epo_pkt_len);
+}
+
+// Close the file and send the GPS back to NMEA mode at the same baud rate
+void gps_epo_finish(byte status)
+{
+  _epo_file.close();
+  _epo_status = status;
+
+  memset(_epo_pkt + 6, 0, 5);  // protocol 0 (NMEA), baud rate 0 (unchanged)
+  gps_epo_frame(MTK_BIN_SET_NMEA, 5);
+  _epo_state = GPS_EPO_ST_NMEA;
+}
@@ -0,0 +1,75 @@
+/*
+   Upload of MTK EPO assistance data from the SD card to the GPS module
+
+   Copyright (c) 2013, Robin Scheibler aka FakuFaku
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+   ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+   WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+   DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+   LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+   ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __GPS_EPO_H__
+#define __GPS_EPO_H__
+
+// Link to arduino library
+#if ARDUINO >= 100
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+// EPO file on the SD card, as distributed by MediaTek
+#define GPS_EPO_FILE "MTK7D.EPO"
+
+// EPO packets
+#define GPS_EPO_SV_SZ       60    // size of one satellite record
+#define GPS_EPO_SV_PER_PKT  3     // satellite records per packet
+#define GPS_EPO_PAYLOAD_SZ  (2 + GPS_EPO_SV_PER_PKT*GPS_EPO_SV_SZ)  // sequence number and records
+#define GPS_EPO_PKT_SZ      (GPS_EPO_PAYLOAD_SZ + 9)  // complete binary frame, 191 bytes
+#define GPS_EPO_SEQ_END     0xFFFF  // sequence number of the final packet
+
+// Upload timing
+#define GPS_EPO_DELAY       1000  // time given to the GPS to start before the upload (ms)
+#define GPS_EPO_TIMEOUT     1000  // time to wait for ACK before resending a packet (ms)
+#define GPS_EPO_RETRY       3     // number of times a packet is sent
+#define GPS_EPO_CHUNK       16    // bytes written to the serial port at once
+
+// Upload status
+#define GPS_EPO_NONE    0   // no upload was done
+#define GPS_EPO_BUSY    1   // upload in progress
+#define GPS_EPO_DONE    2   // upload successful
+#define GPS_EPO_FAILED  3   // upload failed, or bad EPO file
+
+/* start upload of EPO file, if it exists */
+int gps_epo_start(char *filename, unsigned long baud);
+
+/* run upload, call from main loop after gps_update() */
+void gps_epo_update();
+
+/* abort upload, e.g. when GPS is turned off */
+void gps_epo_stop();
+
+/* upload status and number of satellite records sent */
+byte gps_epo_status();
+unsigned int gps_epo_records();
+
+#endif /* __GPS_EPO_H__ */
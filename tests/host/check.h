@@ -0,0 +1,42 @@
+/*
+   Checks of the host tests
+
+   A failed check prints the file, line and expression, the test goes on.
+   main() returns check_result(), non zero when a check failed.
+
+   This file is in the public domain.
+*/
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int check_failed = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) \
+    { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      check_failed++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    long _a = (long)(a), _b = (long)(b); \
+    if (_a != _b) \
+    { \
+      printf("%s:%d: check failed: %s == %s, %ld != %ld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+      check_failed++; \
+    } \
+  } while (0)
+
+static int check_result(const char *name)
+{
+  printf("%s: %s\n", name, check_failed ? "FAILED" : "ok");
+  return check_failed != 0;
+}
+
+#endif /* CHECK_H */
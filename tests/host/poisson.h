@@ -0,0 +1,41 @@
+/*
+   Poisson counts for the host tests
+
+   A linear congruential generator seeded by the test, so that every run
+   draws the same counts, and Knuth's method for the Poisson draw, fine for
+   the few tens of counts per bin of the tests.
+
+   This file is in the public domain.
+*/
+
+#ifndef POISSON_H
+#define POISSON_H
+
+#include <math.h>
+#include <stdint.h>
+
+static uint32_t poisson_seed = 1;
+
+// Uniform in [0, 1)
+static double uniform()
+{
+  poisson_seed = poisson_seed * 1664525UL + 1013904223UL;
+  return (poisson_seed >> 8) / 16777216.0;
+}
+
+// Poisson count of mean mu
+static unsigned long poisson(double mu)
+{
+  double l = exp(-mu), p = 1;
+  unsigned long k = 0;
+
+  do
+  {
+    k++;
+    p *= uniform();
+  } while (p > l);
+
+  return k - 1;
+}
+
+#endif /* POISSON_H */
@@ -0,0 +1,153 @@
+/*
+   Arduino core stub to build the library on the host
+
+   This file is in the public domain.
+*/
+
+#include <Arduino.h>
+
+// registers
+volatile uint8_t SREG = 0x80;
+volatile uint8_t TIMSK0, OCR0A, OCR0B;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1;
+volatile uint8_t TCCR3A, TCCR3B, TIMSK3, TIFR3;
+volatile uint16_t TCNT3;
+
+// time
+unsigned long stub_ms;
+
+unsigned long millis()
+{
+  return stub_ms;
+}
+
+unsigned long micros()
+{
+  return stub_ms * 1000;
+}
+
+void delay(unsigned long ms)
+{
+  stub_ms += ms;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+}
+
+// pins
+void (*stub_ext_isr)(void);
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+}
+
+int digitalRead(uint8_t pin)
+{
+  return LOW;
+}
+
+void attachInterrupt(uint8_t num, void (*isr)(void), int mode)
+{
+  stub_ext_isr = isr;
+}
+
+void detachInterrupt(uint8_t num)
+{
+  stub_ext_isr = NULL;
+}
+
+// printing, to the bytes sent
+size_t Print::print(const char *s)
+{
+  size_t n = 0;
+  while (*s != '\0')
+    n += write(*s++);
+  return n;
+}
+
+size_t Print::print(char c)
+{
+  return write(c);
+}
+
+size_t Print::print(long n)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%ld", n);
+  return print(buf);
+}
+
+size_t Print::print(unsigned long n)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%lu", n);
+  return print(buf);
+}
+
+size_t Print::print(double x)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.2f", x);
+  return print(buf);
+}
+
+size_t Print::println()
+{
+  return write('\r') + write('\n');
+}
+
+// serial ports
+HardwareSerial::HardwareSerial()
+{
+  baud = 0;
+  rx = NULL;
+  rx_len = 0;
+  tx_len = 0;
+}
+
+void HardwareSerial::begin(unsigned long b)
+{
+  baud = b;
+}
+
+void HardwareSerial::end()
+{
+}
+
+int HardwareSerial::available()
+{
+  return rx_len;
+}
+
+int HardwareSerial::read()
+{
+  if (rx_len == 0)
+    return -1;
+  rx_len--;
+  return (uint8_t)*rx++;
+}
+
+int HardwareSerial::peek()
+{
+  return (rx_len == 0) ? -1 : (uint8_t)*rx;
+}
+
+void HardwareSerial::flush()
+{
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  if (tx_len < sizeof(tx))
+    tx[tx_len++] = c;
+  return 1;
+}
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
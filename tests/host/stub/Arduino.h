@@ -0,0 +1,102 @@
+/*
+   Arduino core stub to build the library on the host
+
+   Only what the library files under test use is declared. The registers
+   are plain variables the tests set and read, the millis() clock is
+   advanced by the tests, and the interrupt routines are functions the
+   tests call.
+
+   This file is in the public domain.
+*/
+
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+typedef uint8_t byte;
+typedef uint8_t boolean;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define _BV(bit) (1 << (bit))
+#define _SFR_BYTE(sfr) (sfr)
+
+// time, stub_ms is advanced by the tests
+extern unsigned long stub_ms;
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// pins, the external interrupt routine is kept for the tests
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t num, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t num);
+extern void (*stub_ext_isr)(void);
+
+// The serial ports of the core, the calls go through the vtable
+class Print
+{
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t print(const char *s);
+    size_t print(char c);
+    size_t print(long n);
+    size_t print(unsigned long n);
+    size_t print(int n) { return print((long)n); }
+    size_t print(unsigned int n) { return print((unsigned long)n); }
+    size_t print(double x);
+    size_t println();
+    template <class T> size_t println(T v) { return print(v) + println(); }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual size_t write(uint8_t c) = 0;
+};
+
+// The bytes to receive are put in rx, the bytes sent are added to tx
+class HardwareSerial : public Stream
+{
+  public:
+    HardwareSerial();
+    void begin(unsigned long baud);
+    void end();
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual void flush();
+    virtual size_t write(uint8_t c);
+
+    unsigned long baud;
+    const char *rx;
+    unsigned int rx_len;
+    char tx[256];
+    unsigned int tx_len;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif /* ARDUINO_STUB_H */
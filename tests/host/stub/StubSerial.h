@@ -0,0 +1,68 @@
+/*
+   Serial port stub for GpsReceiver<StubSerial>
+
+   The port is a plain class, its calls are resolved at compile time. The
+   bytes to receive are given to feed(), at most chunk bytes are available
+   at once, as from a serial port read in a loop. The bytes sent are kept
+   in tx.
+
+   This file is in the public domain.
+*/
+
+#ifndef STUB_SERIAL_H
+#define STUB_SERIAL_H
+
+#include <Arduino.h>
+
+class StubSerial
+{
+  public:
+    StubSerial() : baud(0), tx_len(0), _rx(NULL), _rx_len(0), _chunk(0), _avail(0) {}
+
+    // the next bytes to receive, chunk at a time
+    void feed(const char *buf, unsigned int n, unsigned int chunk)
+    {
+      _rx = buf;
+      _rx_len = n;
+      _chunk = chunk;
+    }
+
+    // the next chunk of the bytes fed is available
+    void next_chunk()
+    {
+      _avail = (_rx_len < _chunk) ? _rx_len : _chunk;
+    }
+
+    int available() { return _avail; }
+    int read()
+    {
+      if (_avail == 0)
+        return -1;
+      _avail--;
+      _rx_len--;
+      return (uint8_t)*_rx++;
+    }
+    size_t write(uint8_t c)
+    {
+      if (tx_len < sizeof(tx) - 1)
+        tx[tx_len++] = c;
+      tx[tx_len] = '\0';
+      return 1;
+    }
+    void flush() {}
+    void begin(unsigned long b) { baud = b; }
+
+    unsigned int left() { return _rx_len; }
+
+    unsigned long baud;
+    char tx[256];
+    unsigned int tx_len;
+
+  private:
+    const char *_rx;
+    unsigned int _rx_len;
+    unsigned int _chunk;
+    unsigned int _avail;
+};
+
+#endif /* STUB_SERIAL_H */
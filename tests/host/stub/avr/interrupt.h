@@ -0,0 +1,21 @@
+/*
+   AVR interrupt stub
+
+   cli() and sei() clear and set the I bit of SREG, so that the tests can
+   check the state is restored. An ISR is a plain function the tests call
+   to emulate the interrupt.
+
+   This file is in the public domain.
+*/
+
+#ifndef AVR_INTERRUPT_STUB_H
+#define AVR_INTERRUPT_STUB_H
+
+#include <avr/io.h>
+
+#define cli() (SREG &= ~0x80)
+#define sei() (SREG |= 0x80)
+
+#define ISR(vector) extern "C" void vector(void); extern "C" void vector(void)
+
+#endif /* AVR_INTERRUPT_STUB_H */
@@ -0,0 +1,41 @@
+/*
+   AVR registers stub, the timers and interrupt flags the library uses
+
+   The registers are plain variables, defined in Arduino.cpp. Timer3 is
+   defined as on the ATmega1284P.
+
+   This file is in the public domain.
+*/
+
+#ifndef AVR_IO_STUB_H
+#define AVR_IO_STUB_H
+
+#include <stdint.h>
+
+extern volatile uint8_t SREG;
+
+// Timer0, the millis() tick, its compare interrupts are free
+extern volatile uint8_t TIMSK0, OCR0A, OCR0B;
+#define OCIE0A 1
+#define OCIE0B 2
+
+// Timer1
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1;
+#define CS10  0
+#define CS11  1
+#define CS12  2
+#define TOIE1 0
+#define TOV1  0
+
+// Timer3, tested with defined(TCNT3) as on the AVR
+extern volatile uint8_t TCCR3A, TCCR3B, TIMSK3, TIFR3;
+extern volatile uint16_t TCNT3;
+#define TCNT3 TCNT3
+#define CS30  0
+#define CS31  1
+#define CS32  2
+#define TOIE3 0
+#define TOV3  0
+
+#endif /* AVR_IO_STUB_H */
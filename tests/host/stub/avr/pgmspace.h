@@ -0,0 +1,30 @@
+/*
+   AVR program memory stub, flash is ordinary memory on the host
+
+   This file is in the public domain.
+*/
+
+#ifndef AVR_PGMSPACE_STUB_H
+#define AVR_PGMSPACE_STUB_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define pgm_read_word(p)  (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+
+#define strcpy_P    strcpy
+#define strncpy_P   strncpy
+#define strcmp_P    strcmp
+#define strncmp_P   strncmp
+#define strlen_P    strlen
+#define memcpy_P    memcpy
+#define sprintf_P   sprintf
+#define snprintf_P  snprintf
+
+#endif /* AVR_PGMSPACE_STUB_H */
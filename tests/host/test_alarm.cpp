@@ -0,0 +1,117 @@
+/*
+   Host test of the rate alarm
+
+   The alarm is run on Poisson bins of 5 s, the same on every run, over a
+   background of 2.5 counts per bin, 30 CPM:
+    - a rise of 10 times gives the alarm at the first bin, of 4 times
+      after 2 bins, a doubling after about 7 bins
+    - a false alarm comes about once every 4000 bins, 5 to 6 hours
+    - a lasting doubling of the background ends the alarm after
+      RA_RELEARN bins, and the background is the new rate
+   A steady rise is also checked bin by bin against RA_RELEARN.
+
+   This file is in the public domain.
+*/
+
+#include <algorithm>
+#include <RateAlarm.h>
+#include "poisson.h"
+#include "check.h"
+
+#define MU_BG 2.5     // counts in a bin of 5 s at 30 CPM
+
+static RateAlarm ra;
+
+// Bins until the alarm after a rise of gain times, over many trials,
+// returns the delay of the given fraction of the trials
+unsigned int delay(double gain, unsigned int trials, unsigned int pc)
+{
+  static unsigned int d[1000];
+  unsigned int t, i;
+
+  for (t = 0 ; t < trials ; t++)
+  {
+    do
+    {
+      ra.reset();
+      for (i = 0 ; i < 200 ; i++)
+        ra.add(poisson(MU_BG));
+    } while (ra.alarm());
+
+    d[t] = 1;
+    while (!ra.add(poisson(gain * MU_BG)))
+      d[t]++;
+  }
+
+  std::sort(d, d + trials);
+  return d[trials * pc / 100];
+}
+
+void test_delay()
+{
+  CHECK(delay(10, 1000, 99) <= 1);
+  CHECK(delay(4, 1000, 50) <= 2);
+  CHECK(delay(4, 1000, 99) <= 5);
+  CHECK(delay(2, 1000, 50) <= 10);
+  CHECK(delay(2, 1000, 90) <= 20);
+}
+
+void test_false_alarm(unsigned long bins)
+{
+  unsigned long i, n = 0;
+  byte last = 0, a;
+
+  ra.reset();
+  for (i = 0 ; i < bins ; i++)
+  {
+    a = ra.add(poisson(MU_BG));
+    if (a && !last)
+      n++;
+    last = a;
+  }
+
+  // about bins / 4000
+  CHECK(n > bins / 8000);
+  CHECK(n < bins / 2500);
+}
+
+// A rise that lasts is the new background
+void test_relearn()
+{
+  unsigned long i, on = 0;
+
+  // a steady rise, the alarm ends after RA_RELEARN bins
+  ra.reset();
+  for (i = 0 ; i < RA_LEARN ; i++)
+    ra.add(2);
+  CHECK(ra.ready());
+  for (i = 1 ; i < RA_RELEARN ; i++)
+    CHECK(ra.add(25));
+  CHECK(!ra.add(25));
+  CHECK(!ra.ready());
+  for (i = 0 ; i < 100 ; i++)
+    CHECK(!ra.add(25));
+  CHECK(ra.ready());
+  CHECK(ra.background() == 25.0);
+
+  // a doubling of the background on Poisson bins
+  ra.reset();
+  for (i = 0 ; i < 200 ; i++)
+    ra.add(poisson(MU_BG));
+  for (i = 0 ; i < 20000 ; i++)
+    if (ra.add(poisson(2 * MU_BG)))
+      on++;
+  CHECK(on < 200);
+  CHECK(!ra.alarm());
+  CHECK(ra.background() > 4.5);
+  CHECK(ra.background() < 6.0);
+}
+
+int main()
+{
+  test_delay();
+  test_false_alarm(1000000);
+  test_relearn();
+
+  return check_result("test_alarm");
+}
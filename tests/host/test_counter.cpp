@@ -0,0 +1,190 @@
+/*
+   Host test of the hardware counter
+
+   Timer1 is emulated: each pulse increments TCNT1, the wrap from 0xFFFF
+   to 0 sets TOV1 in TIFR1, and the overflow interrupt runs only when the
+   test says so, with interrupts on. The bins are read with next_bin()
+   while the overflow interrupt is sometimes late, as when the loop reads
+   the counter with interrupts off or right after the wrap. The sum of the
+   bins must be the number of pulses sent, across the 16 bit wraps of the
+   timer. long has 64 bits on the host, so the wrap of the total at 2^32
+   of the AVR is not tested here.
+   Two counters cleared together then have their bins closed by the same
+   Timer0 compare B interrupt, with the same ends, and read in pairs.
+
+   This file is in the public domain.
+*/
+
+#include <HardwareCounter.h>
+#include "check.h"
+
+extern "C" void TIMER1_OVF_vect(void);
+extern "C" void TIMER0_COMPB_vect(void);
+
+static unsigned long sent;      // pulses sent since start()
+static unsigned long seed = 1;
+
+// Pseudo random numbers, the same on every run
+unsigned long rnd(unsigned long n)
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return ((seed >> 8) & 0xFFFFFF) % n;
+}
+
+// n pulses on T1, the wrap sets the overflow flag as on the AVR
+void pulses(unsigned long n)
+{
+  sent += n;
+  while (n-- > 0)
+    if (++TCNT1 == 0)
+      TIFR1 |= _BV(TOV1);
+}
+
+// The overflow interrupt runs if it is pending and interrupts are on
+void overflow_isr()
+{
+  if ((SREG & 0x80) && (TIFR1 & _BV(TOV1)))
+  {
+    TIFR1 &= ~_BV(TOV1);
+    TIMER1_OVF_vect();
+  }
+}
+
+// Start the counter, the flag is cleared by writing a one on the AVR and
+// the stub keeps what is written, so it is cleared here
+void start(HardwareCounter *c)
+{
+  c->start();
+  TIFR1 = 0;
+  sent = 0;
+}
+
+// Bins of up to 40000 pulses, the overflow interrupt runs right after the
+// wrap, or the read comes between the wrap and the interrupt, or right
+// before the wrap. Each bin must be the pulses sent since the last one.
+void test_next_bin(unsigned int bins)
+{
+  HardwareCounter counter(1, 5000);
+  unsigned long sum = 0, last = 0, bin;
+  unsigned int i, late = 0;
+
+  start(&counter);
+
+  for (i = 0 ; i < bins ; i++)
+  {
+    pulses(rnd(40000));
+    overflow_isr();
+
+    switch (rnd(3))
+    {
+      case 0:
+        bin = counter.next_bin();
+        break;
+
+      case 1:
+        // the timer wrapped, the interrupt is pending
+        pulses(0x10000 - TCNT1 + rnd(100));
+        late++;
+        bin = counter.next_bin();
+        overflow_isr();
+        break;
+
+      default:
+        // the timer is about to wrap
+        if (TCNT1 > 0xFF00)
+          pulses(rnd(0xFFFF - TCNT1));
+        else
+          pulses(0xFF00 - TCNT1 + rnd(0xFF));
+        bin = counter.next_bin();
+        break;
+    }
+
+    CHECK_EQ(bin, sent - last);
+    last = sent;
+    sum += bin;
+  }
+
+  CHECK_EQ(sum, sent);
+  CHECK_EQ(SREG, 0x80);   // interrupts are on again
+  CHECK(late > bins / 4);
+}
+
+// count() then start() zeroes the timer, the bins are the pulses since start()
+void test_count()
+{
+  HardwareCounter counter(1, 5000);
+  unsigned int i;
+  unsigned long n;
+
+  for (i = 0 ; i < 100 ; i++)
+  {
+    start(&counter);
+    n = rnd(200000);
+    while (n > 30000)
+    {
+      pulses(30000);
+      overflow_isr();
+      n -= 30000;
+    }
+    pulses(n);
+    CHECK_EQ(counter.count(), sent);
+  }
+}
+
+// Counters on Timer1 and Timer3 started in the same critical section
+void test_pairs()
+{
+  HardwareCounter counter(1, 5000);
+  TimerCounter<Timer3> counter2(2, 5000);
+  bin_t bin, bin2;
+  unsigned int i, n = 0;
+
+  stub_ms = 1001;
+  counter.setup();
+  counter2.setup();
+  cli();
+  counter.clear();
+  counter2.clear();
+  sei();
+  TIFR1 = 0;
+  TIFR3 = 0;
+  counter.schedule();
+  counter2.schedule();
+
+  // a tick every 2 ms, the bins are read every 3 s
+  for (i = 0 ; i < 50000 ; i++)
+  {
+    stub_ms += 2;
+    pulses(3);
+    overflow_isr();
+    TCNT3 += 1;     // does not wrap in the test
+    TIMER0_COMPB_vect();
+    if (i == 20000)
+    {
+      counter.align(stub_ms + 1234);
+      counter2.align(stub_ms + 1234);
+    }
+    if (i % 1500 == 0)
+    {
+      while (counter.get_bin(&bin))
+      {
+        CHECK(counter2.get_bin(&bin2));
+        CHECK_EQ(bin2.end, bin.end);
+        CHECK_EQ(bin2.start, bin.start);
+        CHECK_EQ(bin.count, 3 * bin2.count);
+        n++;
+      }
+      CHECK(!counter2.get_bin(&bin2));
+    }
+  }
+  CHECK(n > 15);
+}
+
+int main()
+{
+  test_next_bin(10000);
+  test_count();
+  test_pairs();
+
+  return check_result("test_counter");
+}
@@ -0,0 +1,296 @@
+/*
+   Host test of the GPS parser
+
+   The captures of data/ are fed through GpsReceiver<StubSerial> as from a
+   serial port at 9600 bps, a chunk of bytes every chunk ms, and the fixes
+   of the epochs published are checked along with the parse counters. The
+   captures are fed in chunks of 1, 16 and 64 bytes, a sentence cut
+   anywhere must give the same result.
+
+   mtk.nmea is the output of the MTK module of the bGeigie3, GGA first:
+    - 17:58:35, HDOP 77.2 and 3 satellites, rejected by the filter
+    - 17:58:36 and 17:58:37, accepted
+    - $GPTXT*4F and $GPGGA*56, checksums right but no comma, ignored
+    - an ACK of PMTK220 in between
+    - 17:58:38, RMC with a wrong checksum, not published
+    - 17:58:39, GGA longer than the line buffer, not published
+    - 17:58:40, accepted
+   ublox.nmea is the output of a u-blox receiver, GN talker, RMC first:
+    - 12:00:00 to 12:00:02, accepted
+    - 12:00:03, GGA with HDOP 9.9 and 3 satellites after RMC, rejected
+    - 12:00:04, accepted
+   The filter must gate each fix on the GGA of its own epoch.
+
+   test_gps_1284 is built with the defaults of the ATmega1284P, the epoch
+   buffer and the receive ring. The ring is then also tested through the
+   gps_* functions on Serial1, drained by the Timer0 compare A interrupt.
+
+   This file is in the public domain.
+*/
+
+#include <GPS.h>
+#include <StubSerial.h>
+#include "check.h"
+
+#define EPOCH_MAX 8
+
+static char line[LINE_SZ];
+static char capture[4096];
+
+static GpsReceiver<StubSerial> gps;
+static StubSerial port;
+static gps_fix_t epoch[EPOCH_MAX];    // fixes of the epochs published
+static unsigned int n_epoch;
+
+// Read a capture file of data/
+unsigned int load(const char *name)
+{
+  char path[64];
+  FILE *f;
+  unsigned int n;
+
+  snprintf(path, sizeof(path), "data/%s", name);
+  f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    printf("cannot open %s\n", path);
+    exit(1);
+  }
+  n = fread(capture, 1, sizeof(capture), f);
+  fclose(f);
+  return n;
+}
+
+// Feed a capture to a new receiver, keep the fix of each epoch published
+void replay(const char *name, unsigned int chunk)
+{
+  unsigned int n = load(name);
+  unsigned int seq;
+
+  stub_ms = 1000;
+  port.tx_len = 0;
+  gps.begin(&port, line);
+  seq = gps.seq();
+  n_epoch = 0;
+
+  port.feed(capture, n, chunk);
+  while (port.left() > 0)
+  {
+    stub_ms += chunk;   // about 1 ms per byte at 9600 bps
+    port.next_chunk();
+    gps.update();
+    if (gps.seq() != seq)
+    {
+      seq = gps.seq();
+      if (n_epoch < EPOCH_MAX)
+        epoch[n_epoch] = *gps.getFix();
+      n_epoch++;
+    }
+  }
+}
+
+// UTC time of day in ms
+uint32_t hms(uint32_t h, uint32_t m, uint32_t s)
+{
+  return ((h * 60 + m) * 60 + s) * 1000;
+}
+
+void test_mtk(unsigned int chunk)
+{
+  gps_stats_t stats;
+  gps_track_t track;
+  gps_t *data;
+
+  replay("mtk.nmea", chunk);
+
+  CHECK_EQ(n_epoch, 4);
+  CHECK_EQ(gps.mtk_status(), GPS_MTK_INIT | GPS_MTK_STARTUP);
+
+  // HDOP too high
+  CHECK_EQ(epoch[0].time, hms(17, 58, 35));
+  CHECK_EQ(epoch[0].status, GPS_FIX_VALID | GPS_FIX_REJECTED);
+  CHECK_EQ(epoch[0].hdop, 7720);
+  CHECK_EQ(epoch[0].num_sat, 3);
+
+  CHECK_EQ(epoch[1].time, hms(17, 58, 36));
+  CHECK_EQ(epoch[1].date, GPS_DATE(2012, 12, 16));
+  CHECK_EQ(epoch[1].status, GPS_FIX_VALID);
+  CHECK_EQ(epoch[1].lat, 46315707);   // 46 deg 18.9424 min
+  CHECK_EQ(epoch[1].lon, 6974670);    // 6 deg 58.4802 min
+  CHECK_EQ(epoch[1].altitude, 4281);
+  CHECK_EQ(epoch[1].hdop, 127);
+  CHECK_EQ(epoch[1].num_sat, 8);
+  CHECK_EQ(epoch[1].quality, 1);
+  CHECK_EQ(epoch[1].speed, 185);      // 3.60 knots
+  CHECK_EQ(epoch[1].course, 18000);
+
+  CHECK_EQ(epoch[2].time, hms(17, 58, 37));
+  CHECK_EQ(epoch[2].status, GPS_FIX_VALID);
+
+  // 17:58:38 and 17:58:39 are incomplete
+  CHECK_EQ(epoch[3].time, hms(17, 58, 40));
+  CHECK_EQ(epoch[3].status, GPS_FIX_VALID);
+  CHECK_EQ(epoch[3].lat, 46315640);
+  CHECK_EQ(epoch[3].altitude, 4277);
+
+  data = gps.getData();
+  CHECK(strcmp(data->utc, "175840.00") == 0);
+  CHECK(strcmp(data->lat, "4618.9384") == 0);
+  CHECK(strcmp(data->lat_hem, "N") == 0);
+  CHECK(strcmp(data->precision, "1.27") == 0);
+  CHECK(strcmp(data->datetime.second, "40") == 0);
+
+  gps.get_stats(&stats);
+  CHECK_EQ(stats.chk_errors, 1);
+  CHECK_EQ(stats.truncated, 1);
+
+  // the accepted fixes of the published epochs, the distance between the
+  // first two only, the third is 3 s later
+  gps.track_get(&track);
+  CHECK_EQ(track.n_fix, 3);
+  CHECK_EQ(track.distance, 185);
+  CHECK_EQ(track.alt_min, 4277);
+  CHECK_EQ(track.alt_max, 4281);
+}
+
+// A sentence without a comma has no type and is not parsed
+void test_no_comma()
+{
+  const char *s = "$GPTXT*4F\r\n$GPGGA*56\r\n";
+  int parsed = 0;
+
+  gps.begin(&port, line);
+  while (*s != '\0')
+    parsed += gps.encode(*s++);
+  CHECK_EQ(parsed, 0);
+}
+
+// The command is sent at once and its ACK is in the capture
+void test_mtk_command()
+{
+  unsigned int n = load("mtk.nmea");
+
+  stub_ms = 1000;
+  port.tx_len = 0;
+  gps.begin(&port, line);
+
+  CHECK(gps.command(PSTR(MTK_UPDATE_RATE_1HZ)));
+  CHECK(strcmp(port.tx, MTK_UPDATE_RATE_1HZ "\r\n") == 0);
+  CHECK_EQ(gps.command_pending(), 1);
+
+  port.feed(capture, n, 16);
+  while (port.left() > 0)
+  {
+    stub_ms += 16;
+    port.next_chunk();
+    gps.update();
+  }
+
+  CHECK_EQ(gps.command_pending(), 0);
+  CHECK(gps.command_status() & GPS_CMD_ACKED);
+  CHECK(!(gps.command_status() & GPS_CMD_FAILED));
+  CHECK_EQ(gps.command_failures(), 0);
+}
+
+void test_ublox(unsigned int chunk)
+{
+  gps_stats_t stats;
+
+  replay("ublox.nmea", chunk);
+
+  CHECK_EQ(n_epoch, 5);
+  CHECK_EQ(gps.mtk_status(), 0);
+
+  CHECK_EQ(epoch[0].time, hms(12, 0, 0));
+  CHECK_EQ(epoch[0].status, GPS_FIX_VALID);
+  CHECK_EQ(epoch[0].hdop, 92);
+  CHECK_EQ(epoch[0].num_sat, 12);
+  CHECK_EQ(epoch[2].time, hms(12, 0, 2));
+  CHECK_EQ(epoch[2].lat, 46315607);
+  CHECK_EQ(epoch[2].altitude, 4275);
+
+  // gated on the HDOP of the GGA after its RMC
+  CHECK_EQ(epoch[3].time, hms(12, 0, 3));
+  CHECK_EQ(epoch[3].hdop, 990);
+  CHECK_EQ(epoch[3].status, GPS_FIX_VALID | GPS_FIX_REJECTED);
+  CHECK_EQ(epoch[4].time, hms(12, 0, 4));
+  CHECK_EQ(epoch[4].status, GPS_FIX_VALID);
+
+  gps.get_stats(&stats);
+  CHECK_EQ(stats.chk_errors, 0);
+  CHECK_EQ(stats.truncated, 0);
+}
+
+#if GPS_RX_RING_ENABLE
+extern "C" void TIMER0_COMPA_vect(void);
+
+// Feed a capture to Serial1, the interrupt drains it every 16 bytes and
+// the loop reads the ring after every drains
+void replay_ring(const char *name, unsigned int drains)
+{
+  unsigned int n = load(name);
+  unsigned int seq, i;
+
+  stub_ms = 1000;
+  gps_init(&Serial1, line);
+  seq = gps_seq();
+  n_epoch = 0;
+
+  Serial1.rx = capture;
+  while (n > 0)
+  {
+    for (i = 0 ; i < drains && n > 0 ; i++)
+    {
+      Serial1.rx_len = (n < 16) ? n : 16;
+      n -= Serial1.rx_len;
+      stub_ms += 16;
+      TIMER0_COMPA_vect();
+    }
+    gps_update();
+    if (gps_seq() != seq)
+    {
+      seq = gps_seq();
+      if (n_epoch < EPOCH_MAX)
+        epoch[n_epoch] = *gps_getFix();
+      n_epoch++;
+    }
+  }
+}
+
+void test_ring()
+{
+  gps_stats_t stats;
+
+  // the loop reads the ring every 64 bytes
+  replay_ring("mtk.nmea", 4);
+  CHECK_EQ(n_epoch, 4);
+  CHECK_EQ(epoch[1].time, hms(17, 58, 36));
+  CHECK_EQ(epoch[1].lat, 46315707);
+  CHECK_EQ(epoch[3].time, hms(17, 58, 40));
+  gps_get_stats(&stats);
+  CHECK_EQ(stats.dropped, 0);
+  CHECK_EQ(stats.chk_errors, 1);
+
+  // the loop reads the ring every 320 bytes, the ring keeps 255 of them
+  replay_ring("mtk.nmea", 20);
+  gps_get_stats(&stats);
+  CHECK_EQ(stats.dropped, (load("mtk.nmea") / 320) * (320 - 255));
+}
+#endif
+
+int main()
+{
+  test_mtk(1);
+  test_mtk(16);
+  test_mtk(64);
+  test_mtk_command();
+  test_no_comma();
+  test_ublox(1);
+  test_ublox(16);
+  test_ublox(64);
+#if GPS_RX_RING_ENABLE
+  test_ring();
+#endif
+
+  return check_result(TEST_NAME);
+}
@@ -0,0 +1,65 @@
+/*
+   Host test of the pulse timer
+
+   The bins of the histogram must follow each other, 64 us wide up to
+   1024 us then by octaves. Pulses are then timestamped from Timer3 through
+   the external interrupt routine and their intervals counted.
+
+   This file is in the public domain.
+*/
+
+#include <PulseTimer.h>
+#include "check.h"
+
+static PulseTimer ptm(2);
+
+void test_bins()
+{
+  byte b;
+
+  CHECK_EQ(PulseTimer::bin_low(0), 0);
+  CHECK_EQ(PulseTimer::bin_low(1), PT_HIST_W);
+  CHECK_EQ(PulseTimer::bin_low(PT_HIST_LIN), 1024);
+  for (b = 1 ; b < PT_HIST_SZ ; b++)
+  {
+    CHECK_EQ(PulseTimer::bin_of(PulseTimer::bin_low(b)), b);
+    CHECK_EQ(PulseTimer::bin_of(PulseTimer::bin_low(b) - 1), b - 1);
+  }
+  CHECK_EQ(PulseTimer::bin_of(4000000000UL), PT_HIST_SZ - 1);
+}
+
+// A pulse at Timer3 tick t, 1 us at 8 MHz
+void pulse(uint16_t t)
+{
+  TCNT3 = t;
+  stub_ext_isr();
+}
+
+void test_intervals()
+{
+  ptm.start();
+  TIFR3 = 0;
+  CHECK(stub_ext_isr != NULL);
+
+  // the first interval is not counted
+  pulse(100);
+  pulse(200);
+  pulse(250);     // 50 us, a double pulse
+  pulse(350);     // 100 us
+  pulse(1400);    // 1050 us
+  ptm.process();
+
+  CHECK_EQ(ptm.intervals(), 3);
+  CHECK_EQ(ptm.hist(0), 1);
+  CHECK_EQ(ptm.hist(1), 1);
+  CHECK_EQ(ptm.hist(PT_HIST_LIN), 1);
+  CHECK(!ptm.incomplete());
+}
+
+int main()
+{
+  test_bins();
+  test_intervals();
+
+  return check_result("test_pulse");
+}
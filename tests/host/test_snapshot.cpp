@@ -0,0 +1,109 @@
+/*
+   Host test of the atomic counter snapshots
+
+   counter_snapshot16() is given plain variables for the timer, its flag
+   register and the high part, in the three cases of an overflow:
+    - TOV pending and the timer small, read after the wrap, the overflow
+      not yet counted by the interrupt must be added
+    - TOV pending and the timer large, read before the wrap, the overflow
+      must not be added
+    - no TOV pending, the high part is used as is
+   The interrupt state must be the same after the snapshot as before.
+   The InterruptCounter is then counted through its interrupt routine.
+
+   This file is in the public domain.
+*/
+
+#include <counter_snapshot.h>
+#include <InterruptCounter.h>
+#include "check.h"
+
+#define TOV 0
+
+static volatile uint16_t tcnt;
+static volatile uint8_t tifr;
+static volatile unsigned long ext;
+
+void test_snapshot16(uint8_t sreg)
+{
+  SREG = sreg;
+
+  // the timer wrapped, the interrupt did not run yet
+  ext = 0x30000;
+  tifr = _BV(TOV);
+  tcnt = 0x0003;
+  CHECK_EQ(counter_snapshot16(&tcnt, &tifr, TOV, &ext), 0x40003);
+  CHECK_EQ(SREG, sreg);
+
+  // the timer was read just before the wrap that set the flag
+  tcnt = 0xFFFE;
+  CHECK_EQ(counter_snapshot16(&tcnt, &tifr, TOV, &ext), 0x3FFFE);
+  CHECK_EQ(SREG, sreg);
+
+  // no overflow pending
+  tifr = 0;
+  tcnt = 0x0003;
+  CHECK_EQ(counter_snapshot16(&tcnt, &tifr, TOV, &ext), 0x30003);
+  tcnt = 0xFFFE;
+  CHECK_EQ(counter_snapshot16(&tcnt, &tifr, TOV, &ext), 0x3FFFE);
+  CHECK_EQ(SREG, sreg);
+
+  // the other flags of the register do not count
+  tifr = (uint8_t)~_BV(TOV);
+  tcnt = 0x0003;
+  CHECK_EQ(counter_snapshot16(&tcnt, &tifr, TOV, &ext), 0x30003);
+
+  // the total wraps at 2^32, long has 64 bits on the host and only the
+  // 32 bits of the AVR are compared
+  ext = 0xFFFF0000UL;
+  tifr = _BV(TOV);
+  tcnt = 0x0010;
+  CHECK_EQ((uint32_t)counter_snapshot16(&tcnt, &tifr, TOV, &ext), 0x10);
+}
+
+void test_snapshot32(uint8_t sreg)
+{
+  volatile unsigned long cnt = 0x12345678UL;
+
+  SREG = sreg;
+  CHECK_EQ(counter_snapshot32(&cnt), 0x12345678UL);
+  CHECK_EQ(SREG, sreg);
+}
+
+// The pulses are counted by the routine given to attachInterrupt()
+void test_interrupt_counter()
+{
+  unsigned long i;
+
+  SREG = 0x80;
+  stub_ms = 1000;
+  interruptCounterSetup(2, 5000);
+  CHECK(stub_ext_isr != NULL);
+  interruptCounterReset();
+
+  for (i = 0 ; i < 70000 ; i++)
+    stub_ext_isr();
+  CHECK_EQ(interruptCounterCount(), 70000);
+  CHECK_EQ(SREG, 0x80);
+  CHECK(!interruptCounterAvailable());
+
+  stub_ms += 5000;
+  CHECK(interruptCounterAvailable());
+
+  interruptCounterReset();
+  CHECK_EQ(interruptCounterCount(), 0);
+  CHECK_EQ(SREG, 0x80);
+  stub_ext_isr();
+  CHECK_EQ(interruptCounterCount(), 1);
+}
+
+int main()
+{
+  test_snapshot16(0x80);  // from the loop
+  test_snapshot16(0x00);  // from an interrupt, or with interrupts off
+  test_snapshot32(0x80);
+  test_snapshot32(0x00);
+  test_interrupt_counter();
+
+  return check_result("test_snapshot");
+}
@@ -0,0 +1,132 @@
+/*
+   Host test of the count windows
+
+   The window sums and CPM are checked on known bins. The adaptive window
+   is then run on Poisson bins of 5 s, the same on every run:
+    - a step from 30 to 300 CPM must shrink the adaptive window to the last
+      bin in the first bin of the step, in 99% of the trials
+    - the step back to 30 CPM must shrink it in the first bin in most of
+      the trials, and within two bins in 99% of them
+    - on a steady 30 CPM the window must shrink rarely, about once every
+      1300 bins, a false change of 4 sigma
+
+   This file is in the public domain.
+*/
+
+#include <CountWindows.h>
+#include "poisson.h"
+#include "check.h"
+
+#define MU_BG    2.5     // counts in a bin of 5 s at 30 CPM
+#define MU_HIGH  25.0    // at 300 CPM
+
+static CountWindows cw;
+
+// Windows of 1 and 5 min, bins of 5 s
+void test_sums()
+{
+  uint16_t win[CW_WIN_MAX] = { 60, 300, 0 };
+  unsigned int i;
+
+  CHECK(cw.setup(5, win));
+  CHECK_EQ(cw.windows(), 2);
+  CHECK_EQ(cw.length(0), 60);
+  CHECK_EQ(cw.length(1), 300);
+
+  for (i = 0 ; i < 12 ; i++)
+    cw.add(i);
+  CHECK(cw.full(0));
+  CHECK(!cw.full(1));
+  CHECK_EQ(cw.sum(0), 66);
+  CHECK_EQ(cw.cpm(0), 66);
+  CHECK_EQ(cw.sum(1), 66);
+
+  // the first bins leave the minute window
+  for (i = 0 ; i < 12 ; i++)
+    cw.add(10);
+  CHECK_EQ(cw.sum(0), 120);
+  CHECK_EQ(cw.cpm(0), 120);
+  CHECK_EQ(cw.sum(1), 186);
+
+  for (i = 0 ; i < 36 ; i++)
+    cw.add(10);
+  CHECK(cw.full(1));
+  CHECK_EQ(cw.sum(1), 546);
+  CHECK_EQ(cw.cpm(1), 109);
+
+  // and then the five minute window
+  for (i = 0 ; i < 12 ; i++)
+    cw.add(10);
+  CHECK_EQ(cw.sum(1), 600);
+  CHECK_EQ(cw.cpm(1), 120);
+
+  // a steady rate keeps the whole first window
+  CHECK_EQ(cw.adaptive_length(), 60);
+  CHECK_EQ(cw.adaptive_cpm(), 120);
+
+  cw.reset();
+  CHECK(!cw.full(0));
+  CHECK_EQ(cw.sum(0), 0);
+}
+
+void test_step(unsigned int trials)
+{
+  unsigned int t, i, up = 0, down = 0, down2 = 0;
+
+  for (t = 0 ; t < trials ; t++)
+  {
+    cw.reset();
+    for (i = 0 ; i < 60 ; i++)
+      cw.add(poisson(MU_BG));
+
+    cw.add(poisson(MU_HIGH));
+    if (cw.adaptive_length() == 5)
+    {
+      up++;
+      CHECK(cw.adaptive_cpm() > 60);
+    }
+
+    for (i = 0 ; i < 30 ; i++)
+      cw.add(poisson(MU_HIGH));
+
+    cw.add(poisson(MU_BG));
+    if (cw.adaptive_length() == 5)
+      down++;
+    else
+      cw.add(poisson(MU_BG));
+    if (cw.adaptive_length() <= 10)
+      down2++;
+  }
+
+  CHECK(up >= trials * 99 / 100);
+  CHECK(down >= trials * 80 / 100);
+  CHECK(down2 >= trials * 99 / 100);
+}
+
+void test_steady(unsigned long bins)
+{
+  unsigned long i, shrinks = 0;
+  unsigned int last = 0;
+
+  cw.reset();
+  for (i = 0 ; i < bins ; i++)
+  {
+    cw.add(poisson(MU_BG));
+    if (cw.adaptive_length() < last)
+      shrinks++;
+    last = cw.adaptive_length();
+  }
+
+  // about bins / 1300
+  CHECK(shrinks > bins / 3000);
+  CHECK(shrinks < bins / 600);
+}
+
+int main()
+{
+  test_sums();
+  test_step(1000);
+  test_steady(200000);
+
+  return check_result("test_windows");
+}